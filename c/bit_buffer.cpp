@@ -3,11 +3,18 @@
 #include <lzma.h>
 #include <zlib.h>
 #include <zstd.h>
-#include <lz4.h>
+#include <zdict.h>
+#include <lz4frame.h>
 #include <lz4hc.h>
 #include <bzlib.h>
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <climits>
+#include <atomic>
+#include <deque>
+#include <future>
 
 // Define the static constant members
 constexpr uint8_t BitOutBuffer::BYTE_LENGTH;
@@ -20,6 +27,206 @@ int ZSTD_LEVEL = 20;  // 3, 22
 int LZ4_LEVEL = 9;   // 9, 12
 int BZIP2_LEVEL = 9; // 1-9
 
+// Seek table of framed zstd archives, see StreamCompressor
+constexpr uint32_t SKIPPABLE_FRAME_MAGIC = 0x184D2A5E;
+constexpr uint32_t SEEKABLE_MAGIC = 0x8F92EAB1;
+constexpr size_t SKIPPABLE_HEADER_SIZE = 8;  // Magic and size
+constexpr size_t SEEK_ENTRY_SIZE = 8;        // Compressed and raw size
+constexpr size_t SEEK_FOOTER_SIZE = 9;       // Frame count, descriptor and magic
+
+// Zlib header of framed gzip archives (deflate, 32K window, fastest level),
+// and the empty final block that ends their deflate stream
+constexpr uint8_t ZLIB_HEADER[2] = {0x78, 0x01};
+constexpr uint8_t DEFLATE_FINAL_BLOCK[2] = {0x03, 0x00};
+
+constexpr uint32_t LZ4_FRAME_MAGIC = 0x184D2204;
+
+static void put_le32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+static uint32_t get_le32(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+static uint64_t get_le64(const uint8_t* p) {
+    return get_le32(p) | static_cast<uint64_t>(get_le32(p + 4)) << 32;
+}
+
+// Read the seek table at the end of data into the compressed and raw size
+// of each frame. Returns false if data does not end in a seek table that
+// matches its frames, as single-stream archives do not.
+static bool parse_seek_table(const std::vector<uint8_t>& data, std::vector<uint32_t>& entries) {
+    if (data.size() < SKIPPABLE_HEADER_SIZE + SEEK_FOOTER_SIZE) return false;
+    const uint8_t* footer = data.data() + data.size() - SEEK_FOOTER_SIZE;
+    if (get_le32(footer + 5) != SEEKABLE_MAGIC || footer[4] != 0) return false;
+    uint64_t frames = get_le32(footer);
+    uint64_t table_size = SKIPPABLE_HEADER_SIZE + frames * SEEK_ENTRY_SIZE + SEEK_FOOTER_SIZE;
+    if (table_size > data.size()) return false;
+    const uint8_t* table = data.data() + data.size() - table_size;
+    if (get_le32(table) != SKIPPABLE_FRAME_MAGIC || get_le32(table + 4) != table_size - SKIPPABLE_HEADER_SIZE) {
+        return false;
+    }
+    entries.resize(frames * 2);
+    uint64_t compressed_total = 0;
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i] = get_le32(table + SKIPPABLE_HEADER_SIZE + 4 * i);
+    }
+    for (size_t f = 0; f < frames; f++) {
+        if (entries[2 * f] == 0 || entries[2 * f + 1] > StreamCompressor::MAX_FRAME_SIZE) return false;
+        compressed_total += entries[2 * f];
+    }
+    return compressed_total == data.size() - table_size;
+}
+
+// Walk the concatenated xz streams of data back from its end: the footer
+// of each stream gives the size of its index, and the index the size of the
+// whole stream and of its contents. Returns false unless data is made of
+// xz streams with no padding between them, each small enough to be a frame.
+static bool find_xz_streams(const std::vector<uint8_t>& data, std::vector<uint32_t>& entries) {
+    std::vector<uint32_t> reversed;
+    size_t end = data.size();
+    while (end > 0) {
+        if (end < 2 * LZMA_STREAM_HEADER_SIZE) return false;
+        lzma_stream_flags footer;
+        if (lzma_stream_footer_decode(&footer, data.data() + end - LZMA_STREAM_HEADER_SIZE) != LZMA_OK) {
+            return false;
+        }
+        size_t index_end = end - LZMA_STREAM_HEADER_SIZE;
+        if (footer.backward_size > index_end - LZMA_STREAM_HEADER_SIZE) return false;
+        size_t in_pos = index_end - footer.backward_size;
+        lzma_index* index = nullptr;
+        uint64_t memlimit = UINT64_MAX;
+        if (lzma_index_buffer_decode(&index, &memlimit, nullptr, data.data(), &in_pos, index_end) != LZMA_OK) {
+            return false;
+        }
+        uint64_t stream_size = lzma_index_stream_size(index);
+        uint64_t raw_size = lzma_index_uncompressed_size(index);
+        lzma_index_end(index, nullptr);
+        if (in_pos != index_end || stream_size > end || stream_size > UINT32_MAX ||
+            raw_size > StreamCompressor::MAX_FRAME_SIZE) {
+            return false;
+        }
+        reversed.push_back(static_cast<uint32_t>(raw_size));
+        reversed.push_back(static_cast<uint32_t>(stream_size));
+        end -= stream_size;
+    }
+    entries.assign(reversed.rbegin(), reversed.rend());
+    return !entries.empty();
+}
+
+// Walk the concatenated LZ4 frames of data from its start, skipping over
+// their blocks by their size fields. Returns false unless every frame
+// records its content size, as the frames StreamCompressor writes do.
+static bool find_lz4_frames(const std::vector<uint8_t>& data, std::vector<uint32_t>& entries) {
+    entries.clear();
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (data.size() - pos < 7 || get_le32(data.data() + pos) != LZ4_FRAME_MAGIC) return false;
+        uint8_t flags = data[pos + 4];
+        bool block_checksums = flags & 0x10;
+        bool content_size = flags & 0x08;
+        bool content_checksum = flags & 0x04;
+        bool dictionary_id = flags & 0x01;
+        if ((flags >> 6) != 1 || !content_size) return false;
+        size_t header_size = 7 + 8 + (dictionary_id ? 4 : 0);
+        if (data.size() - pos < header_size) return false;
+        uint64_t raw_size = get_le64(data.data() + pos + 6);
+        size_t p = pos + header_size;
+        while (true) {
+            if (data.size() - p < 4) return false;
+            uint32_t block = get_le32(data.data() + p);
+            p += 4;
+            if (block == 0) break;  // End mark
+            size_t block_size = (block & 0x7FFFFFFF) + (block_checksums ? 4 : 0);
+            if (data.size() - p < block_size) return false;
+            p += block_size;
+        }
+        if (content_checksum) {
+            if (data.size() - p < 4) return false;
+            p += 4;
+        }
+        if (p - pos > UINT32_MAX || raw_size > StreamCompressor::MAX_FRAME_SIZE) return false;
+        entries.push_back(static_cast<uint32_t>(p - pos));
+        entries.push_back(static_cast<uint32_t>(raw_size));
+        pos = p;
+    }
+    return !entries.empty();
+}
+
+// Locate the frames of a framed archive, see StreamCompressor. gzip and
+// bzip2 frames can only be found by decoding them, so those archives are
+// decompressed as one stream.
+static bool find_frames(const std::vector<uint8_t>& data, CompressorType compressor,
+                        std::vector<uint32_t>& entries) {
+    switch (compressor) {
+        case CompressorType::ZSTD: return parse_seek_table(data, entries);
+        case CompressorType::LZMA: return find_xz_streams(data, entries);
+        case CompressorType::LZ4: return find_lz4_frames(data, entries);
+        default: return false;
+    }
+}
+
+// Decompress one frame located by find_frames into exactly output_size bytes
+static bool decompress_frame(const uint8_t* data, size_t size, CompressorType compressor,
+                             uint8_t* output, size_t output_size) {
+    if (compressor != CompressorType::LZ4) {
+        return BitCompressor::decompress_buffer(data, size, compressor, output, output_size);
+    }
+    // Frames, unlike the block format BitCompressor uses for sections
+    LZ4F_dctx* dctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) return false;
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    size_t ret = 1;
+    while (ret != 0 && in_pos < size) {
+        size_t src_size = size - in_pos;
+        size_t dst_size = output_size - out_pos;
+        ret = LZ4F_decompress(dctx, output + out_pos, &dst_size, data + in_pos, &src_size, nullptr);
+        if (LZ4F_isError(ret) || (src_size == 0 && dst_size == 0)) break;
+        in_pos += src_size;
+        out_pos += dst_size;
+    }
+    LZ4F_freeDecompressionContext(dctx);
+    return ret == 0 && in_pos == size && out_pos == output_size;
+}
+
+// Decompress the frames listed in entries into output, threads at a time
+static bool decompress_frames(const std::vector<uint8_t>& data, const std::vector<uint32_t>& entries,
+                              CompressorType compressor, int threads, std::vector<uint8_t>& output) {
+    size_t frames = entries.size() / 2;
+    std::vector<size_t> in_offset(frames + 1, 0);
+    std::vector<size_t> out_offset(frames + 1, 0);
+    for (size_t f = 0; f < frames; f++) {
+        in_offset[f + 1] = in_offset[f] + entries[2 * f];
+        out_offset[f + 1] = out_offset[f] + entries[2 * f + 1];
+    }
+    output.resize(out_offset[frames]);
+
+    std::atomic<size_t> next_frame{0};
+    std::atomic<bool> ok{true};
+    auto worker = [&]() {
+        for (size_t f = next_frame++; f < frames && ok; f = next_frame++) {
+            if (!decompress_frame(data.data() + in_offset[f], entries[2 * f], compressor,
+                                  output.data() + out_offset[f], entries[2 * f + 1])) {
+                ok = false;
+            }
+        }
+    };
+    size_t worker_count = std::min(frames, static_cast<size_t>(std::max(threads, 1)));
+    std::vector<std::future<void>> workers;
+    for (size_t w = 1; w < worker_count; w++) {
+        workers.push_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (auto& w : workers) {
+        w.get();
+    }
+    return ok;
+}
+
 // BitOutBuffer implementation
 BitOutBuffer::BitOutBuffer() 
     : current_bits(0)
@@ -28,35 +235,49 @@ BitOutBuffer::BitOutBuffer()
 }
 
 void BitOutBuffer::flush() {
-    while (bit_count >= BYTE_LENGTH) {
-        byte_stream.push_back(
-            static_cast<uint8_t>(current_bits >> (bit_count - BYTE_LENGTH))
-        );
-        current_bits &= (1 << (bit_count - BYTE_LENGTH)) - 1;
-        bit_count -= BYTE_LENGTH;
+    size_t bytes = bit_count / BYTE_LENGTH;
+    if (bytes == 0) return;
+    uint8_t rest = bit_count % BYTE_LENGTH;
+
+    // Left-align the whole bytes and store them as one big-endian word
+    uint64_t word = (current_bits >> rest) << (ACCUMULATOR_BITS - bytes * BYTE_LENGTH);
+    size_t old_size = byte_stream.size();
+    byte_stream.resize(old_size + sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+    std::memcpy(&byte_stream[old_size], &word, sizeof(word));
+#else
+    for (size_t i = 0; i < sizeof(word); i++) {
+        byte_stream[old_size + i] = static_cast<uint8_t>(word >> (ACCUMULATOR_BITS - BYTE_LENGTH * (i + 1)));
     }
+#endif
+    byte_stream.resize(old_size + bytes);
+
+    current_bits &= (1ULL << rest) - 1;
+    bit_count = rest;
 }
 
-void BitOutBuffer::encode(uint32_t data, uint8_t bit_len) {
-    // Mask off any extra bits
-    data &= (1ULL << bit_len) - 1;  // Use 64-bit literal to handle 32-bit values
-    
-    // Add the new bits to the current bits
-    current_bits = (current_bits << bit_len) | data;
-    bit_count += bit_len;
-    
-    // Flush complete bytes
-    while (bit_count >= BYTE_LENGTH) {
-        uint8_t byte = static_cast<uint8_t>(current_bits >> (bit_count - BYTE_LENGTH));
-        byte_stream.push_back(byte);
-        
-        // Remove the byte we just wrote
-        current_bits &= (1ULL << (bit_count - BYTE_LENGTH)) - 1;
-        bit_count -= BYTE_LENGTH;
+void BitOutBuffer::append_bytes(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (bit_count % BYTE_LENGTH == 0) {
+        flush();
+        byte_stream.insert(byte_stream.end(), bytes, bytes + size);
+        return;
+    }
+
+    // Unaligned stream: shift the bytes in through the accumulator, four at a time
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        encode_32(static_cast<uint32_t>(bytes[i]) << 24 | static_cast<uint32_t>(bytes[i + 1]) << 16 |
+                  static_cast<uint32_t>(bytes[i + 2]) << 8 | bytes[i + 3]);
+    }
+    for (; i < size; i++) {
+        encode_8(bytes[i]);
     }
 }
 
 void BitOutBuffer::pack() {
+    flush();
     if (bit_count > 0) {
         // Shift remaining bits to the left to align with byte boundary
         uint8_t byte = static_cast<uint8_t>(current_bits << (BYTE_LENGTH - bit_count));
@@ -127,18 +348,14 @@ bool BitOutBuffer::compress_zstd(std::vector<uint8_t>& output) const {
 }
 
 bool BitOutBuffer::compress_lz4(std::vector<uint8_t>& output) const {
-    int out_size = LZ4_compressBound(byte_stream.size());
+    LZ4F_preferences_t prefs = {};
+    prefs.compressionLevel = LZ4_LEVEL;
+    size_t out_size = LZ4F_compressFrameBound(byte_stream.size(), &prefs);
     output.resize(out_size);
 
-    int compressed_size = LZ4_compress_HC(
-        reinterpret_cast<const char*>(byte_stream.data()),
-        reinterpret_cast<char*>(output.data()),
-        byte_stream.size(),
-        out_size,
-        LZ4_LEVEL
-    );
-    
-    if (compressed_size <= 0) {
+    size_t compressed_size = LZ4F_compressFrame(output.data(), out_size,
+                                                byte_stream.data(), byte_stream.size(), &prefs);
+    if (LZ4F_isError(compressed_size)) {
         return false;
     }
 
@@ -168,6 +385,13 @@ bool BitOutBuffer::compress_bzip2(std::vector<uint8_t>& output) const {
     return true;
 }
 
+std::vector<uint8_t> BitOutBuffer::take_bytes() {
+    pack();
+    std::vector<uint8_t> bytes = std::move(byte_stream);
+    clear();
+    return bytes;
+}
+
 void BitOutBuffer::clear() {
     byte_stream.clear();
     current_bits = 0;
@@ -273,27 +497,15 @@ bool BitOutBuffer::write(const std::string& file_path, const std::string& mode,
 
 // BitInBuffer implementation
 BitInBuffer::BitInBuffer() 
-    : current_bits(0)
+    : data_ptr(nullptr)
+    , data_size(0)
+    , current_bits(0)
     , bit_count(0)
     , byte_position(0) {
     byte_stream.reserve(1024);  // Initial capacity
 }
 
-bool BitInBuffer::read(const std::string& file_path) {
-    // First read the file
-    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
-    if (!file) return false;
-
-    // Get file size
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    // Read file into temporary buffer
-    std::vector<uint8_t> compressed_data(size);
-    if (!file.read(reinterpret_cast<char*>(compressed_data.data()), size)) {
-        return false;
-    }
-
+bool BitInBuffer::read(const std::string& file_path, int threads) {
     // Determine compressor type based on file extension
     CompressorType compressor = CompressorType::NONE;
     std::string ext = file_path.substr(file_path.find_last_of(".") + 1);
@@ -313,72 +525,10 @@ bool BitInBuffer::read(const std::string& file_path) {
         // If no recognized extension, assume no compression
         compressor = CompressorType::NONE;
     }
-
-    // Decompress based on compressor type
-    bool decompression_success = true;
-    
-    switch(compressor) {
-        case CompressorType::LZMA: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_lzma(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
-            }
-            break;
-        }
-        case CompressorType::GZIP: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_gzip(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
-            }
-            break;
-        }
-        case CompressorType::ZSTD: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_zstd(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
-            }
-            break;
-        }
-        case CompressorType::LZ4: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_lz4(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
-            }
-            break;
-        }
-        case CompressorType::BZIP2: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_bzip2(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
-            }
-            break;
-        }
-        case CompressorType::NONE:
-            byte_stream = compressed_data;
-            break;
-    }
-
-    if (!decompression_success) return false;
-
-    // Reset temporary buffer
-    current_bits = 0;
-    bit_count = 0;
-    byte_position = 0;
-
-    return true;
+    return read(file_path, compressor, threads);
 }
 
-bool BitInBuffer::read(const std::string& file_path, CompressorType compressor) {
+bool BitInBuffer::read(const std::string& file_path, CompressorType compressor, int threads) {
     // First read the file
     std::ifstream file(file_path, std::ios::binary | std::ios::ate);
     if (!file) return false;
@@ -393,63 +543,74 @@ bool BitInBuffer::read(const std::string& file_path, CompressorType compressor)
         return false;
     }
 
-    // Decompress based on specified compressor type
     bool decompression_success = true;
-    
-    switch(compressor) {
-        case CompressorType::LZMA: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_lzma(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
-            }
-            break;
+    std::vector<uint32_t> frames;
+    if (compressor != CompressorType::NONE && find_frames(compressed_data, compressor, frames)) {
+        // The frames of framed archives are independent
+        std::vector<uint8_t> decompressed;
+        decompression_success = decompress_frames(compressed_data, frames, compressor, threads, decompressed);
+        if (decompression_success) {
+            byte_stream = std::move(decompressed);
         }
-        case CompressorType::GZIP: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_gzip(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
+    } else {
+        // One stream, or frames that are decoded in turn
+        switch(compressor) {
+            case CompressorType::LZMA: {
+                byte_stream = compressed_data;
+                std::vector<uint8_t> decompressed;
+                decompression_success = decompress_lzma(decompressed);
+                if (decompression_success) {
+                    byte_stream = std::move(decompressed);
+                }
+                break;
             }
-            break;
-        }
-        case CompressorType::ZSTD: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_zstd(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
+            case CompressorType::GZIP: {
+                byte_stream = compressed_data;
+                std::vector<uint8_t> decompressed;
+                decompression_success = decompress_gzip(decompressed);
+                if (decompression_success) {
+                    byte_stream = std::move(decompressed);
+                }
+                break;
             }
-            break;
-        }
-        case CompressorType::LZ4: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_lz4(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
+            case CompressorType::ZSTD: {
+                byte_stream = compressed_data;
+                std::vector<uint8_t> decompressed;
+                decompression_success = decompress_zstd(decompressed);
+                if (decompression_success) {
+                    byte_stream = std::move(decompressed);
+                }
+                break;
             }
-            break;
-        }
-        case CompressorType::BZIP2: {
-            byte_stream = compressed_data;
-            std::vector<uint8_t> decompressed;
-            decompression_success = decompress_bzip2(decompressed);
-            if (decompression_success) {
-                byte_stream = std::move(decompressed);
+            case CompressorType::LZ4: {
+                byte_stream = compressed_data;
+                std::vector<uint8_t> decompressed;
+                decompression_success = decompress_lz4(decompressed);
+                if (decompression_success) {
+                    byte_stream = std::move(decompressed);
+                }
+                break;
             }
-            break;
+            case CompressorType::BZIP2: {
+                byte_stream = compressed_data;
+                std::vector<uint8_t> decompressed;
+                decompression_success = decompress_bzip2(decompressed);
+                if (decompression_success) {
+                    byte_stream = std::move(decompressed);
+                }
+                break;
+            }
+            case CompressorType::NONE:
+                byte_stream = compressed_data;
+                break;
         }
-        case CompressorType::NONE:
-            byte_stream = compressed_data;
-            break;
     }
 
     if (!decompression_success) return false;
 
     // Reset temporary buffer
+    data_ptr = byte_stream.data();
+    data_size = byte_stream.size();
     current_bits = 0;
     bit_count = 0;
     byte_position = 0;
@@ -457,11 +618,21 @@ bool BitInBuffer::read(const std::string& file_path, CompressorType compressor)
     return true;
 }
 
+void BitInBuffer::attach(const uint8_t* bytes, size_t size) {
+    byte_stream.clear();
+    data_ptr = bytes;
+    data_size = size;
+    current_bits = 0;
+    bit_count = 0;
+    byte_position = 0;
+}
+
 bool BitInBuffer::decompress_lzma(std::vector<uint8_t>& output) const {
     lzma_stream strm = LZMA_STREAM_INIT;
     lzma_ret ret;
 
-    ret = lzma_auto_decoder(&strm, UINT64_MAX, 0);
+    // Framed archives are several concatenated xz streams
+    ret = lzma_auto_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED);
     if (ret != LZMA_OK) return false;
 
     // Start with output buffer same size as input
@@ -540,118 +711,162 @@ bool BitInBuffer::decompress_gzip(std::vector<uint8_t>& output) const {
 bool BitInBuffer::decompress_zstd(std::vector<uint8_t>& output) const {
     // Get decompressed size
     unsigned long long const decompressed_size = ZSTD_getFrameContentSize(byte_stream.data(), byte_stream.size());
-    if (decompressed_size == ZSTD_CONTENTSIZE_ERROR || decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    if (decompressed_size == ZSTD_CONTENTSIZE_ERROR) {
         return false;
     }
 
-    output.resize(decompressed_size);
-    size_t const decompressed_bytes = ZSTD_decompress(output.data(), decompressed_size,
-                                                    byte_stream.data(), byte_stream.size());
-    
-    if (ZSTD_isError(decompressed_bytes)) {
-        return false;
+    if (decompressed_size != ZSTD_CONTENTSIZE_UNKNOWN) {
+        output.resize(decompressed_size);
+        size_t const decompressed_bytes = ZSTD_decompress(output.data(), decompressed_size,
+                                                        byte_stream.data(), byte_stream.size());
+
+        if (ZSTD_isError(decompressed_bytes)) {
+            return false;
+        }
+
+        output.resize(decompressed_bytes);
+        return true;
+    }
+
+    // Streamed frames do not record their size, decode them incrementally
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    if (dctx == nullptr) return false;
+
+    output.resize(byte_stream.size() * 4 + ZSTD_DStreamOutSize());
+    ZSTD_inBuffer in = {byte_stream.data(), byte_stream.size(), 0};
+    size_t out_pos = 0;
+    size_t ret = 0;
+    while (in.pos < in.size) {
+        if (out_pos == output.size()) {
+            output.resize(output.size() * 2);
+        }
+        ZSTD_outBuffer out = {output.data() + out_pos, output.size() - out_pos, 0};
+        ret = ZSTD_decompressStream(dctx, &out, &in);
+        if (ZSTD_isError(ret)) {
+            ZSTD_freeDCtx(dctx);
+            return false;
+        }
+        out_pos += out.pos;
+    }
+    // Drain data still buffered inside the decoder
+    while (ret != 0) {
+        if (out_pos == output.size()) {
+            output.resize(output.size() * 2);
+        }
+        ZSTD_outBuffer out = {output.data() + out_pos, output.size() - out_pos, 0};
+        ret = ZSTD_decompressStream(dctx, &out, &in);
+        if (ZSTD_isError(ret) || (out.pos == 0 && ret != 0)) {
+            ZSTD_freeDCtx(dctx);
+            return false;
+        }
+        out_pos += out.pos;
     }
 
-    output.resize(decompressed_bytes);
+    ZSTD_freeDCtx(dctx);
+    output.resize(out_pos);
     return true;
 }
 
 bool BitInBuffer::decompress_lz4(std::vector<uint8_t>& output) const {
-    // For LZ4, we need to know the original size
-    // Since LZ4 doesn't store the original size in the compressed data,
-    // we'll need to estimate it or store it separately
-    // For now, we'll use a reasonable estimate: input size * 4
-    size_t estimated_size = byte_stream.size() * 4;
-    output.resize(estimated_size);
-    
-    int decompressed_size = LZ4_decompress_safe(
-        reinterpret_cast<const char*>(byte_stream.data()),
-        reinterpret_cast<char*>(output.data()),
-        byte_stream.size(),
-        estimated_size
-    );
-    
-    if (decompressed_size < 0) {
+    // LZ4 data is written in the frame format, which is self-delimiting
+    LZ4F_dctx* dctx = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
         return false;
     }
-    
-    output.resize(decompressed_size);
+
+    output.resize(byte_stream.size() * 4 + 65536);
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    size_t ret = 1;
+    // Framed archives are several frames back to back, each ending at ret 0.
+    // Output the decoder still holds is drained once the input is consumed.
+    while (in_pos < byte_stream.size() || ret != 0) {
+        if (out_pos == output.size()) {
+            output.resize(output.size() * 2);
+        }
+        size_t src_size = byte_stream.size() - in_pos;
+        size_t dst_size = output.size() - out_pos;
+        ret = LZ4F_decompress(dctx, output.data() + out_pos, &dst_size,
+                              byte_stream.data() + in_pos, &src_size, nullptr);
+        if (LZ4F_isError(ret) || (src_size == 0 && dst_size == 0)) {
+            LZ4F_freeDecompressionContext(dctx);
+            return false;
+        }
+        in_pos += src_size;
+        out_pos += dst_size;
+    }
+
+    LZ4F_freeDecompressionContext(dctx);
+    output.resize(out_pos);
     return true;
 }
 
 bool BitInBuffer::decompress_bzip2(std::vector<uint8_t>& output) const {
-    // Start with output buffer same size as input * 4 (reasonable estimate)
-    unsigned int out_size = byte_stream.size() * 4;
-    output.resize(out_size);
-    
-    int ret = BZ2_bzBuffToBuffDecompress(
-        reinterpret_cast<char*>(output.data()),
-        &out_size,
-        const_cast<char*>(reinterpret_cast<const char*>(byte_stream.data())),
-        byte_stream.size(),
-        0,
-        0
-    );
-    
-    if (ret != BZ_OK) {
-        // If buffer was too small, try with larger buffer
-        if (ret == BZ_OUTBUFF_FULL) {
-            out_size = byte_stream.size() * 10;
-            output.resize(out_size);
-            ret = BZ2_bzBuffToBuffDecompress(
-                reinterpret_cast<char*>(output.data()),
-                &out_size,
-                const_cast<char*>(reinterpret_cast<const char*>(byte_stream.data())),
-                byte_stream.size(),
-                0,
-                0
-            );
+    bz_stream strm = {};
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+        return false;
+    }
+
+    // Start with output buffer input * 4 (reasonable estimate), grow as needed
+    output.resize(byte_stream.size() * 4 + 4096);
+    strm.next_in = const_cast<char*>(reinterpret_cast<const char*>(byte_stream.data()));
+    strm.avail_in = byte_stream.size();
+    size_t out_pos = 0;
+
+    while (true) {
+        if (out_pos == output.size()) {
+            output.resize(output.size() * 2);
         }
-        
-        if (ret != BZ_OK) {
+        strm.next_out = reinterpret_cast<char*>(output.data() + out_pos);
+        strm.avail_out = output.size() - out_pos;
+
+        int ret = BZ2_bzDecompress(&strm);
+        out_pos = output.size() - strm.avail_out;
+        if (ret == BZ_STREAM_END) {
+            // Framed archives are several streams back to back
+            if (strm.avail_in == 0) break;
+            char* next_in = strm.next_in;
+            unsigned int avail_in = strm.avail_in;
+            BZ2_bzDecompressEnd(&strm);
+            strm = {};
+            if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return false;
+            strm.next_in = next_in;
+            strm.avail_in = avail_in;
+            continue;
+        }
+        if (ret != BZ_OK || (strm.avail_in == 0 && strm.avail_out != 0)) {
+            BZ2_bzDecompressEnd(&strm);
             return false;
         }
     }
-    
-    output.resize(out_size);
+
+    BZ2_bzDecompressEnd(&strm);
+    output.resize(out_pos);
     return true;
 }
 
-uint32_t BitInBuffer::decode(uint8_t bit_len) {
-    if (bit_len == 0 || bit_len > 32) {
-        throw std::invalid_argument("Bit length must be between 1 and 32");
+void BitInBuffer::refill_tail() {
+    // Fewer than eight bytes left: load them one at a time
+    while (bit_count + BYTE_LENGTH < ACCUMULATOR_BITS && byte_position < data_size) {
+        current_bits |= static_cast<uint64_t>(data_ptr[byte_position++]) << (ACCUMULATOR_BITS - BYTE_LENGTH - bit_count);
+        bit_count += BYTE_LENGTH;
     }
-    
-    uint32_t result = 0;
-    uint8_t bits_remaining = bit_len;
-
-    while (bits_remaining > 0) {
-        // If we need more bits, read from the byte stream
-        if (bit_count < bits_remaining) {
-            if (byte_position >= byte_stream.size()) {
-                throw std::runtime_error("Attempting to read past end of buffer");
-            }
+}
 
-            // Read a new byte and add it to current_bits - OPTIMIZED: no erase()
-            uint8_t new_byte = byte_stream[byte_position++];
-            current_bits = (current_bits << BYTE_LENGTH) | new_byte;
-            bit_count += BYTE_LENGTH;
+void BitInBuffer::decode_bytes(uint8_t* buffer, size_t count) {
+    if (count == 0) return;
+    if (!is_aligned()) {
+        for (size_t i = 0; i < count; i++) {
+            buffer[i] = decode_8();
         }
-
-        // Extract bits from current_bits
-        uint8_t bits_to_read = std::min(bits_remaining, bit_count);
-        uint32_t value = (current_bits >> (bit_count - bits_to_read)) & ((1 << bits_to_read) - 1);
-        
-        // Update result and remaining bits
-        result = (result << bits_to_read) | value;
-        bits_remaining -= bits_to_read;
-        bit_count -= bits_to_read;
-        
-        // Clear used bits from current_bits
-        current_bits &= (1 << bit_count) - 1;
+        return;
     }
-
-    return result;
+    size_t offset = byte_offset();
+    if (count > data_size - offset) {
+        throw std::runtime_error("Attempting to read past end of buffer");
+    }
+    std::memcpy(buffer, data_ptr + offset, count);
+    seek(offset + count);
 }
 
 bool BitCompressor::compress_file(const std::string& input_path, const std::string& output_path, CompressorType compressor) {
@@ -670,27 +885,7 @@ bool BitCompressor::compress_file(const std::string& input_path, const std::stri
     }
 
     // Add appropriate extension based on compressor type
-    std::string final_output_path = output_path;
-    switch(compressor) {
-        case CompressorType::LZMA:
-            final_output_path += ".lzma";
-            break;
-        case CompressorType::GZIP:
-            final_output_path += ".gzip";
-            break;
-        case CompressorType::ZSTD:
-            final_output_path += ".zstd";
-            break;
-        case CompressorType::LZ4:
-            final_output_path += ".lz4";
-            break;
-        case CompressorType::BZIP2:
-            final_output_path += ".bz2";
-            break;
-        case CompressorType::NONE:
-            final_output_path += ".bin";
-            break;
-    }
+    std::string final_output_path = output_path + extension(compressor);
 
     // Compress based on compressor type
     std::vector<uint8_t> compressed_data;
@@ -700,7 +895,7 @@ bool BitCompressor::compress_file(const std::string& input_path, const std::stri
             lzma_stream strm = LZMA_STREAM_INIT;
             lzma_ret ret;
 
-            ret = lzma_easy_encoder(&strm, 6, LZMA_CHECK_CRC64);
+            ret = lzma_easy_encoder(&strm, LZMA_LEVEL, LZMA_CHECK_CRC64);
             if (ret != LZMA_OK) return false;
 
             compressed_data.resize(input_data.size() + (input_data.size() / 2) + 1024);
@@ -751,18 +946,14 @@ bool BitCompressor::compress_file(const std::string& input_path, const std::stri
         }
 
         case CompressorType::LZ4: {
-            int out_size = LZ4_compressBound(input_data.size());
+            LZ4F_preferences_t prefs = {};
+            prefs.compressionLevel = LZ4_LEVEL;
+            size_t out_size = LZ4F_compressFrameBound(input_data.size(), &prefs);
             compressed_data.resize(out_size);
 
-            int compressed_size = LZ4_compress_HC(
-                reinterpret_cast<const char*>(input_data.data()),
-                reinterpret_cast<char*>(compressed_data.data()),
-                input_data.size(),
-                out_size,
-                LZ4_LEVEL
-            );
-            
-            if (compressed_size <= 0) {
+            size_t compressed_size = LZ4F_compressFrame(compressed_data.data(), out_size,
+                                                        input_data.data(), input_data.size(), &prefs);
+            if (LZ4F_isError(compressed_size)) {
                 return false;
             }
 
@@ -816,6 +1007,373 @@ bool BitCompressor::compress_file(const std::string& input_path, const std::stri
     return true;
 }
 
+std::string BitCompressor::extension(CompressorType compressor) {
+    switch(compressor) {
+        case CompressorType::LZMA:
+            return ".lzma";
+        case CompressorType::GZIP:
+            return ".gzip";
+        case CompressorType::ZSTD:
+            return ".zstd";
+        case CompressorType::LZ4:
+            return ".lz4";
+        case CompressorType::BZIP2:
+            return ".bz2";
+        case CompressorType::NONE:
+            break;
+    }
+    return ".bin";
+}
+
+std::vector<uint8_t> ZstdDictionary::train(const std::vector<std::string_view>& samples) {
+    std::string joined;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+    for (std::string_view sample : samples) {
+        joined.append(sample.data(), sample.size());
+        sizes.push_back(sample.size());
+    }
+    std::vector<uint8_t> dictionary(std::clamp(joined.size() / 100, MIN_CAPACITY, MAX_CAPACITY));
+    size_t size = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), joined.data(),
+                                        sizes.data(), static_cast<unsigned>(sizes.size()));
+    if (ZDICT_isError(size)) return {};
+    dictionary.resize(size);
+    return dictionary;
+}
+
+ZstdDictionary::ZstdDictionary(std::vector<uint8_t> bytes)
+    : dictionary_bytes(std::move(bytes))
+    , cdict(ZSTD_createCDict(dictionary_bytes.data(), dictionary_bytes.size(), ZSTD_LEVEL))
+    , ddict(ZSTD_createDDict(dictionary_bytes.data(), dictionary_bytes.size())) {}
+
+ZstdDictionary::~ZstdDictionary() {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+}
+
+bool BitCompressor::compress_buffer(const uint8_t* data, size_t size, CompressorType compressor,
+                                    int level, std::vector<uint8_t>& output,
+                                    const ZstdDictionary* dictionary) {
+    switch(compressor) {
+        case CompressorType::LZMA: {
+            output.resize(lzma_stream_buffer_bound(size));
+            size_t out_pos = 0;
+            uint32_t preset = level == DEFAULT_LEVEL ? LZMA_LEVEL : level;
+            if (lzma_easy_buffer_encode(preset, LZMA_CHECK_CRC64, nullptr, data, size,
+                                        output.data(), &out_pos, output.size()) != LZMA_OK) {
+                return false;
+            }
+            output.resize(out_pos);
+            return true;
+        }
+        case CompressorType::GZIP: {
+            uLong out_size = compressBound(size);
+            output.resize(out_size);
+            if (compress2(output.data(), &out_size, data, size,
+                          level == DEFAULT_LEVEL ? GZIP_LEVEL : level) != Z_OK) {
+                return false;
+            }
+            output.resize(out_size);
+            return true;
+        }
+        case CompressorType::ZSTD: {
+            output.resize(ZSTD_compressBound(size));
+            size_t compressed_size;
+            if (dictionary != nullptr) {
+                ZSTD_CCtx* cctx = ZSTD_createCCtx();
+                if (cctx == nullptr) return false;
+                compressed_size = ZSTD_compress_usingCDict(cctx, output.data(), output.size(), data, size,
+                                                           dictionary->cdict);
+                ZSTD_freeCCtx(cctx);
+            } else {
+                compressed_size = ZSTD_compress(output.data(), output.size(), data, size,
+                                                level == DEFAULT_LEVEL ? ZSTD_LEVEL : level);
+            }
+            if (ZSTD_isError(compressed_size)) return false;
+            output.resize(compressed_size);
+            return true;
+        }
+        case CompressorType::LZ4: {
+            // The block format needs no frame, the caller keeps the size
+            if (size > LZ4_MAX_INPUT_SIZE) return false;
+            int bound = LZ4_compressBound(static_cast<int>(size));
+            output.resize(bound);
+            const char* src = reinterpret_cast<const char*>(data);
+            char* dst = reinterpret_cast<char*>(output.data());
+            int lz4_level = level == DEFAULT_LEVEL ? LZ4_LEVEL : level;
+            int compressed_size = lz4_level > 0
+                ? LZ4_compress_HC(src, dst, static_cast<int>(size), bound, lz4_level)
+                : LZ4_compress_default(src, dst, static_cast<int>(size), bound);
+            if (compressed_size <= 0) return false;
+            output.resize(compressed_size);
+            return true;
+        }
+        case CompressorType::BZIP2: {
+            if (size > UINT_MAX / 2) return false;
+            unsigned int out_size = size + size / 100 + 600;
+            output.resize(out_size);
+            if (BZ2_bzBuffToBuffCompress(reinterpret_cast<char*>(output.data()), &out_size,
+                                         const_cast<char*>(reinterpret_cast<const char*>(data)), size,
+                                         level == DEFAULT_LEVEL ? BZIP2_LEVEL : level, 0, 0) != BZ_OK) {
+                return false;
+            }
+            output.resize(out_size);
+            return true;
+        }
+        case CompressorType::NONE:
+            output.assign(data, data + size);
+            return true;
+    }
+    return false;
+}
+
+bool BitCompressor::decompress_buffer(const uint8_t* data, size_t size, CompressorType compressor,
+                                      uint8_t* output, size_t output_size,
+                                      const ZstdDictionary* dictionary) {
+    switch(compressor) {
+        case CompressorType::LZMA: {
+            uint64_t memlimit = UINT64_MAX;
+            size_t in_pos = 0;
+            size_t out_pos = 0;
+            return lzma_stream_buffer_decode(&memlimit, 0, nullptr, data, &in_pos, size,
+                                             output, &out_pos, output_size) == LZMA_OK &&
+                   in_pos == size && out_pos == output_size;
+        }
+        case CompressorType::GZIP: {
+            uLongf out_size = output_size;
+            return uncompress(output, &out_size, data, size) == Z_OK && out_size == output_size;
+        }
+        case CompressorType::ZSTD: {
+            size_t out_size;
+            if (dictionary != nullptr) {
+                ZSTD_DCtx* dctx = ZSTD_createDCtx();
+                if (dctx == nullptr) return false;
+                out_size = ZSTD_decompress_usingDDict(dctx, output, output_size, data, size,
+                                                      dictionary->ddict);
+                ZSTD_freeDCtx(dctx);
+            } else {
+                out_size = ZSTD_decompress(output, output_size, data, size);
+            }
+            return !ZSTD_isError(out_size) && out_size == output_size;
+        }
+        case CompressorType::LZ4: {
+            if (size > LZ4_MAX_INPUT_SIZE || output_size > LZ4_MAX_INPUT_SIZE) return false;
+            int out_size = LZ4_decompress_safe(reinterpret_cast<const char*>(data),
+                                               reinterpret_cast<char*>(output),
+                                               static_cast<int>(size), static_cast<int>(output_size));
+            return out_size >= 0 && static_cast<size_t>(out_size) == output_size;
+        }
+        case CompressorType::BZIP2: {
+            if (size > UINT_MAX || output_size > UINT_MAX) return false;
+            unsigned int out_size = output_size;
+            return BZ2_bzBuffToBuffDecompress(reinterpret_cast<char*>(output), &out_size,
+                                              const_cast<char*>(reinterpret_cast<const char*>(data)),
+                                              size, 0, 0) == BZ_OK &&
+                   out_size == output_size;
+        }
+        case CompressorType::NONE:
+            if (size != output_size) return false;
+            std::copy(data, data + size, output);
+            return true;
+    }
+    return false;
+}
+
+// StreamCompressor implementation
+
+// Compress one frame of a framed archive into a stream of the compressor's
+// own format, except for gzip (see StreamCompressor)
+static bool compress_frame(const std::vector<uint8_t>& raw, CompressorType compressor,
+                           std::vector<uint8_t>& output) {
+    switch (compressor) {
+        case CompressorType::GZIP: {
+            // Raw deflate ending in a sync flush, which leaves it on a byte
+            // boundary without a final block
+            z_stream strm = {};
+            if (deflateInit2(&strm, GZIP_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return false;
+            }
+            output.resize(deflateBound(&strm, raw.size()) + 16);
+            strm.next_in = const_cast<Bytef*>(raw.data());
+            strm.avail_in = raw.size();
+            size_t out_pos = 0;
+            do {
+                if (out_pos == output.size()) {
+                    output.resize(output.size() * 2);
+                }
+                strm.next_out = output.data() + out_pos;
+                strm.avail_out = output.size() - out_pos;
+                if (deflate(&strm, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+                    deflateEnd(&strm);
+                    return false;
+                }
+                out_pos = output.size() - strm.avail_out;
+            } while (strm.avail_out == 0);
+            deflateEnd(&strm);
+            output.resize(out_pos);
+            return true;
+        }
+        case CompressorType::LZ4: {
+            // The frame format, as archives were written before framing;
+            // the content size lets BitInBuffer locate the frames
+            LZ4F_preferences_t prefs = {};
+            prefs.compressionLevel = LZ4_LEVEL;
+            prefs.frameInfo.contentSize = raw.size();
+            output.resize(LZ4F_compressFrameBound(raw.size(), &prefs));
+            size_t compressed_size = LZ4F_compressFrame(output.data(), output.size(),
+                                                        raw.data(), raw.size(), &prefs);
+            if (LZ4F_isError(compressed_size)) return false;
+            output.resize(compressed_size);
+            return true;
+        }
+        default:
+            return BitCompressor::compress_buffer(raw.data(), raw.size(), compressor,
+                                                  BitCompressor::DEFAULT_LEVEL, output);
+    }
+}
+
+struct StreamCompressor::FrameState {
+    struct Frame {
+        std::vector<uint8_t> bytes;
+        uint32_t raw_size = 0;
+        uLong adler = 0;  // Of the raw bytes, for gzip
+        bool ok = false;
+    };
+
+    std::ofstream file;
+    std::vector<uint8_t> frame;          // Bytes of the frame being filled
+    std::deque<std::future<Frame>> in_flight;  // Frames being compressed, oldest first
+    std::vector<uint32_t> seek_table;    // Compressed and raw size of each written frame
+    uLong adler = adler32(0, Z_NULL, 0);  // Of all bytes written so far, for gzip
+    size_t max_in_flight = 1;
+    bool parallel = false;
+    bool active = false;
+};
+
+StreamCompressor::StreamCompressor()
+    : state(new FrameState())
+    , compressor(CompressorType::NONE) {}
+
+StreamCompressor::~StreamCompressor() = default;
+
+bool StreamCompressor::open(const std::string& output_path, CompressorType compressor_type, int threads) {
+    compressor = compressor_type;
+    final_path = output_path + BitCompressor::extension(compressor);
+
+    try {
+        std::filesystem::path out_path(final_path);
+        if (out_path.has_parent_path()) {
+            std::filesystem::create_directories(out_path.parent_path());
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: Failed to create directory for file '" << final_path << "': " << e.what() << std::endl;
+        return false;
+    }
+
+    state->file.open(final_path, std::ios::binary | std::ios::trunc);
+    if (!state->file) {
+        std::cerr << "Error: Failed to open file '" << final_path << "' for writing" << std::endl;
+        return false;
+    }
+    if (compressor == CompressorType::GZIP) {
+        state->file.write(reinterpret_cast<const char*>(ZLIB_HEADER), sizeof(ZLIB_HEADER));
+    }
+    state->parallel = threads > 1;
+    state->max_in_flight = std::max(threads, 1);
+    state->active = true;
+    return state->file.good();
+}
+
+bool StreamCompressor::write(const uint8_t* data, size_t size) {
+    if (!state->active) return false;
+    if (compressor == CompressorType::NONE) {
+        state->file.write(reinterpret_cast<const char*>(data), size);
+        return state->file.good();
+    }
+
+    std::vector<uint8_t>& frame = state->frame;
+    while (size > 0) {
+        size_t take = std::min(size, MAX_FRAME_SIZE - frame.size());
+        frame.insert(frame.end(), data, data + take);
+        data += take;
+        size -= take;
+        if (frame.size() == MAX_FRAME_SIZE && !submit_frame()) return false;
+    }
+    return frame.size() < FRAME_SIZE || submit_frame();
+}
+
+bool StreamCompressor::submit_frame() {
+    CompressorType codec = compressor;
+    auto compress = [codec](std::vector<uint8_t> raw) {
+        FrameState::Frame frame;
+        frame.raw_size = static_cast<uint32_t>(raw.size());
+        frame.ok = compress_frame(raw, codec, frame.bytes);
+        if (codec == CompressorType::GZIP) {
+            frame.adler = adler32(adler32(0, Z_NULL, 0), raw.data(), raw.size());
+        }
+        return frame;
+    };
+    state->in_flight.push_back(std::async(state->parallel ? std::launch::async : std::launch::deferred,
+                                          compress, std::move(state->frame)));
+    state->frame.clear();
+    while (state->in_flight.size() > state->max_in_flight) {
+        if (!write_frame()) return false;
+    }
+    return true;
+}
+
+bool StreamCompressor::write_frame() {
+    FrameState::Frame frame = state->in_flight.front().get();
+    state->in_flight.pop_front();
+    if (!frame.ok || frame.bytes.size() > UINT32_MAX) return false;
+    state->file.write(reinterpret_cast<const char*>(frame.bytes.data()), frame.bytes.size());
+    state->seek_table.push_back(static_cast<uint32_t>(frame.bytes.size()));
+    state->seek_table.push_back(frame.raw_size);
+    state->adler = adler32_combine(state->adler, frame.adler, frame.raw_size);
+    return state->file.good();
+}
+
+bool StreamCompressor::finish() {
+    if (!state->active) return false;
+    state->active = false;
+    bool ok = true;
+
+    if (compressor != CompressorType::NONE) {
+        if (!state->frame.empty()) {
+            ok = submit_frame();
+        }
+        while (!state->in_flight.empty()) {
+            ok = write_frame() && ok;
+        }
+    }
+    std::vector<uint8_t> trailer;
+    if (ok && compressor == CompressorType::ZSTD) {
+        uint32_t frames = static_cast<uint32_t>(state->seek_table.size() / 2);
+        put_le32(trailer, SKIPPABLE_FRAME_MAGIC);
+        put_le32(trailer, static_cast<uint32_t>(frames * SEEK_ENTRY_SIZE + SEEK_FOOTER_SIZE));
+        for (uint32_t value : state->seek_table) {
+            put_le32(trailer, value);
+        }
+        put_le32(trailer, frames);
+        trailer.push_back(0);  // Descriptor: no checksums
+        put_le32(trailer, SEEKABLE_MAGIC);
+    } else if (ok && compressor == CompressorType::GZIP) {
+        // End the deflate stream, then the zlib checksum, big-endian
+        trailer.assign(DEFLATE_FINAL_BLOCK, DEFLATE_FINAL_BLOCK + sizeof(DEFLATE_FINAL_BLOCK));
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            trailer.push_back(static_cast<uint8_t>(state->adler >> shift));
+        }
+    }
+    state->file.write(reinterpret_cast<const char*>(trailer.data()), trailer.size());
+
+    state->file.close();
+    if (!ok || state->file.fail()) {
+        std::cerr << "Error: Failed to write compressed file '" << final_path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 #ifdef BITBUFFER_TEST
 #include <iostream>
 #include <random>
@@ -2,7 +2,11 @@
 #define BIT_BUFFER_HPP
 
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 // Compression types
@@ -27,21 +31,57 @@ public:
     BitOutBuffer& operator=(const BitOutBuffer&) = delete;
 
     // Public methods
-    void encode(uint32_t data, uint8_t bit_len = 8);
+    // Append the low bit_len (at most 32) bits of data, most significant first
+    inline void encode(uint32_t data, uint8_t bit_len = 8) {
+        if (bit_count + bit_len > ACCUMULATOR_BITS) {
+            flush();
+        }
+        current_bits = (current_bits << bit_len) | (data & ((1ULL << bit_len) - 1));
+        bit_count += bit_len;
+    }
+
+    // Fixed-width fields, with the width known at compile time
+    template <uint8_t BITS>
+    inline void encode_fixed(uint32_t data) {
+        static_assert(BITS > 0 && BITS <= 32, "field width must be 1 to 32 bits");
+        if (bit_count + BITS > ACCUMULATOR_BITS) {
+            flush();
+        }
+        current_bits = (current_bits << BITS) | (data & ((1ULL << BITS) - 1));
+        bit_count += BITS;
+    }
+
+    inline void encode_32(uint32_t data) {
+        encode_fixed<32>(data);
+    }
+
+    inline void encode_16(uint16_t data) {
+        encode_fixed<16>(data);
+    }
+
+    inline void encode_8(uint8_t data) {
+        encode_fixed<8>(data);
+    }
+
+    // Append raw bytes, copied in bulk when the stream is byte aligned
+    void append_bytes(const void* data, size_t size);
+
     void pack();
     size_t length();
     bool write(const std::string& file_path, const std::string& mode = "wb", CompressorType compressor = CompressorType::NONE);
-    const std::vector<uint8_t>& get_bytes() const { return byte_stream; }
+    const std::vector<uint8_t>& get_bytes() const { return byte_stream; }  // Complete as of the last pack()
+    std::vector<uint8_t> take_bytes();  // Pack and move the bytes out, leaving the buffer empty
     void clear();
 
 private:
     static constexpr uint8_t BYTE_LENGTH = 8;
+    static constexpr uint8_t ACCUMULATOR_BITS = 64;
     std::vector<uint8_t> byte_stream;
-    uint32_t current_bits;
-    uint8_t bit_count;
+    uint64_t current_bits;  // Pending bits, the oldest one highest
+    uint8_t bit_count;      // Number of bits in current_bits
 
     // Private methods
-    void flush();
+    void flush();  // Move the whole bytes of current_bits to byte_stream
     bool compress_lzma(std::vector<uint8_t>& output) const;
     bool compress_gzip(std::vector<uint8_t>& output) const;
     bool compress_zstd(std::vector<uint8_t>& output) const;
@@ -60,44 +100,140 @@ public:
     BitInBuffer& operator=(const BitInBuffer&) = delete;
 
     // Public methods
-    uint32_t decode(uint8_t bit_len);
-    bool read(const std::string& file_path);
-    bool read(const std::string& file_path, CompressorType compressor);
-    
-    // Optimized batch decode methods - inline for performance
-    inline void decode_bytes(uint8_t* buffer, size_t count) {
-        for (size_t i = 0; i < count; i++) {
-            buffer[i] = static_cast<uint8_t>(decode(8));
+    // Read the next bit_len (1 to 32) bits, most significant first
+    inline uint32_t decode(uint8_t bit_len) {
+        if (bit_len == 0 || bit_len > 32) {
+            throw std::invalid_argument("Bit length must be between 1 and 32");
         }
+        ensure(bit_len);
+        uint32_t value = static_cast<uint32_t>(peek(bit_len));
+        consume(bit_len);
+        return value;
     }
+
+    // Read the next bit_len (1 to 64) bits
+    inline uint64_t decode_64(uint8_t bit_len = 64) {
+        if (bit_len <= 32) {
+            return decode(bit_len);
+        }
+        uint64_t high = decode(bit_len - 32);
+        return high << 32 | decode(32);
+    }
+
+    // Make at least bit_len (at most MAX_PEEK_BITS) bits available to
+    // peek(), throwing at the end of the buffer
+    inline void ensure(uint8_t bit_len) {
+        if (bit_count < bit_len) {
+            refill();
+            if (bit_count < bit_len) {
+                throw std::runtime_error("Attempting to read past end of buffer");
+            }
+        }
+    }
+    // Refill and return the number of bits available to peek(), 0 at the end
+    inline uint8_t buffered() {
+        if (bit_count <= MAX_PEEK_BITS) {
+            refill();
+        }
+        return bit_count;
+    }
+    // The next bit_len (1 to MAX_PEEK_BITS) bits without consuming them; only
+    // the bits made available by ensure() are meaningful
+    inline uint64_t peek(uint8_t bit_len) const {
+        return current_bits >> (ACCUMULATOR_BITS - bit_len);
+    }
+    inline void consume(uint8_t bit_len) {
+        current_bits <<= bit_len;
+        bit_count -= bit_len;
+    }
+
+    // Read and decompress a whole file, picking the compressor from the
+    // extension. The frames of framed archives (see StreamCompressor) are
+    // decompressed on up to threads threads.
+    bool read(const std::string& file_path, int threads = 1);
+    bool read(const std::string& file_path, CompressorType compressor, int threads = 1);
+    // Decode from bytes owned by the caller; they must outlive this buffer
+    void attach(const uint8_t* bytes, size_t size);
+
+    const uint8_t* data() const { return data_ptr; }
+    size_t size() const { return data_size; }
+    // Offset of the next unread byte, exact when the stream is aligned
+    size_t byte_offset() const { return byte_position - bit_count / BYTE_LENGTH; }
+    // Offset of the next unread bit from the start of the data
+    uint64_t bit_offset() const { return static_cast<uint64_t>(byte_position) * BYTE_LENGTH - bit_count; }
+    void seek(size_t offset) {
+        byte_position = offset;
+        current_bits = 0;
+        bit_count = 0;
+    }
+    void seek_bits(uint64_t offset) {
+        seek(offset / BYTE_LENGTH);
+        if (offset % BYTE_LENGTH != 0) {
+            ensure(offset % BYTE_LENGTH);
+            consume(offset % BYTE_LENGTH);
+        }
+    }
+    
+    // Copy count bytes into buffer, straight from the data when aligned
+    void decode_bytes(uint8_t* buffer, size_t count);
     
     inline uint32_t decode_32() {
-        return decode(32);
+        ensure(32);
+        uint32_t value = static_cast<uint32_t>(peek(32));
+        consume(32);
+        return value;
     }
     
     inline uint16_t decode_16() {
-        return static_cast<uint16_t>(decode(16));
+        ensure(16);
+        uint16_t value = static_cast<uint16_t>(peek(16));
+        consume(16);
+        return value;
     }
     
     inline uint8_t decode_8() {
-        return static_cast<uint8_t>(decode(8));
+        ensure(8);
+        uint8_t value = static_cast<uint8_t>(peek(8));
+        consume(8);
+        return value;
     }
 
     bool is_aligned() const { return bit_count % 8 == 0; }
     void align() {
-        while (!is_aligned()) {
-            decode(1);
-        }
+        consume(bit_count % BYTE_LENGTH);
     }
 
+    static constexpr uint8_t MAX_PEEK_BITS = 56;
+
 private:
     static constexpr uint8_t BYTE_LENGTH = 8;
+    static constexpr uint8_t ACCUMULATOR_BITS = 64;
     std::vector<uint8_t> byte_stream;
-    uint32_t current_bits;  // Temporary buffer for unused bits
+    const uint8_t* data_ptr;  // Bytes being decoded: byte_stream or attached memory
+    size_t data_size;
+    uint64_t current_bits;  // Unread bits, left aligned; bits below bit_count may hold later data
     uint8_t bit_count;      // Number of bits in current_bits
-    size_t byte_position;   // Current position in byte_stream (NEW)
+    size_t byte_position;   // Next byte of data_ptr to load into current_bits
 
     // Private methods
+    // Load whole bytes until current_bits holds more than MAX_PEEK_BITS
+    // bits, or the data runs out
+    inline void refill() {
+        if (byte_position + sizeof(uint64_t) <= data_size) {
+            uint64_t word;
+            std::memcpy(&word, data_ptr + byte_position, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            word = __builtin_bswap64(word);
+#endif
+            current_bits |= word >> bit_count;
+            uint8_t bytes = (ACCUMULATOR_BITS - 1 - bit_count) / BYTE_LENGTH;
+            byte_position += bytes;
+            bit_count += bytes * BYTE_LENGTH;
+        } else {
+            refill_tail();
+        }
+    }
+    void refill_tail();
     bool decompress_lzma(std::vector<uint8_t>& output) const;
     bool decompress_gzip(std::vector<uint8_t>& output) const;
     bool decompress_zstd(std::vector<uint8_t>& output) const;
@@ -105,9 +241,115 @@ private:
     bool decompress_bzip2(std::vector<uint8_t>& output) const;
 };
 
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+// A zstd dictionary shared by every section of an archive, digested once
+// for compression and once for decompression. Both digests are read only
+// and can be used from several threads.
+class ZstdDictionary {
+public:
+    static constexpr size_t MIN_CAPACITY = 1024;
+    static constexpr size_t MAX_CAPACITY = 112640;  // The zstd command line's default
+
+    // Train a dictionary from samples, of about a hundredth of their size
+    // within MIN_CAPACITY and MAX_CAPACITY. Returns an empty vector if zstd
+    // cannot train one, such as from too few samples.
+    static std::vector<uint8_t> train(const std::vector<std::string_view>& samples);
+
+    explicit ZstdDictionary(std::vector<uint8_t> bytes);
+    ~ZstdDictionary();
+
+    ZstdDictionary(const ZstdDictionary&) = delete;
+    ZstdDictionary& operator=(const ZstdDictionary&) = delete;
+
+    bool valid() const { return cdict != nullptr && ddict != nullptr; }
+    const std::vector<uint8_t>& bytes() const { return dictionary_bytes; }
+
+private:
+    friend class BitCompressor;
+    std::vector<uint8_t> dictionary_bytes;
+    ZSTD_CDict_s* cdict;  // Digested at the zstd level of whole archives
+    ZSTD_DDict_s* ddict;
+};
+
 class BitCompressor {
 public:
+    static constexpr int DEFAULT_LEVEL = -1;  // The level used for whole archives
+
     static bool compress_file(const std::string& input_path, const std::string& output_path, CompressorType compressor);
+    static std::string extension(CompressorType compressor);  // ".lzma", ".zstd", ... or ".bin"
+
+    // Compress size bytes of data on their own into output. For LZ4 a level
+    // of 0 selects the fast compressor, higher levels LZ4 HC. zstd uses
+    // dictionary when one is given, at the dictionary's level. Returns false
+    // if the codec fails, the caller can then store the bytes as they are.
+    static bool compress_buffer(const uint8_t* data, size_t size, CompressorType compressor,
+                                int level, std::vector<uint8_t>& output,
+                                const ZstdDictionary* dictionary = nullptr);
+    // Decompress data written by compress_buffer into the output_size bytes
+    // at output, output_size being the exact decompressed size
+    static bool decompress_buffer(const uint8_t* data, size_t size, CompressorType compressor,
+                                  uint8_t* output, size_t output_size,
+                                  const ZstdDictionary* dictionary = nullptr);
+    static bool decompress_buffer(const uint8_t* data, size_t size, CompressorType compressor,
+                                  std::vector<uint8_t>& output,
+                                  const ZstdDictionary* dictionary = nullptr) {
+        return decompress_buffer(data, size, compressor, output.data(), output.size(), dictionary);
+    }
+};
+
+// Streams bytes through a secondary compressor into a single output file.
+// The bytes are cut into frames of at least FRAME_SIZE bytes, each ending
+// where a write() ends, and every frame is compressed on its own. Up to
+// threads frames are compressed at the same time while later writes fill
+// the next one, so memory stays bounded by a few frames instead of the
+// whole archive. The output is the same for any thread count.
+//
+// The file stays a valid file of the compressor's format, which its
+// command line tool decodes, and BitInBuffer::read locates the frames to
+// decompress them in parallel where the format allows it:
+// - zstd: the frames, then a seek table laid out as in zstd's seekable
+//   format so zstd tools skip it: a skippable frame (magic 0x184D2A5E,
+//   then its size) holding the compressed and raw size of each frame,
+//   then the frame count, a descriptor byte of 0 and the magic 0x8F92EAB1.
+//   Fields other than the descriptor are 32-bit little-endian.
+// - lzma: one xz stream per frame, located from their indexes.
+// - lz4: one LZ4 frame per frame, recording its content size, located
+//   from their block sizes.
+// - bzip2: one bzip2 stream per frame, decompressed in turn.
+// - gzip: a single zlib stream, as BitCompressor writes, whose deflate
+//   data is the frames compressed independently and each ended with a sync
+//   flush, as pigz does, with the checksum combined from theirs.
+//   Decompressed in turn.
+// Without a compressor the bytes are written as they are, with no frames.
+// The output path gets the extension of the compressor, the same as
+// BitCompressor::compress_file.
+class StreamCompressor {
+public:
+    static constexpr size_t FRAME_SIZE = 16 << 20;
+    static constexpr size_t MAX_FRAME_SIZE = 64 << 20;  // Writes larger than this are split
+
+    StreamCompressor();
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    bool open(const std::string& output_path, CompressorType compressor, int threads = 1);
+    bool write(const uint8_t* data, size_t size);
+    bool write(const std::vector<uint8_t>& bytes) { return write(bytes.data(), bytes.size()); }
+    bool finish();  // Compress the last frame, end the format's stream and close the file
+    const std::string& path() const { return final_path; }
+
+private:
+    struct FrameState;  // Frames in flight and what the trailer needs, kept out of the header
+    std::unique_ptr<FrameState> state;
+    CompressorType compressor;
+    std::string final_path;
+
+    bool submit_frame();  // Start compressing the frame being filled
+    bool write_frame();   // Wait for the oldest frame in flight and write it
 };
 
 #endif // BIT_BUFFER_HPP
@@ -1,9 +1,9 @@
 #include "bit_packing.hpp"
+#include "bit_unpack.hpp"
 #include <stdexcept>
 #include <iostream>
 #include <algorithm>
-#include <bitset>
-#include <cmath>
+#include <string>
 
 // Calculate the number of bits needed to represent a number
 static int get_bit_width(int num) {
@@ -23,89 +23,63 @@ static int find_max(const std::vector<int>& arr) {
     return *std::max_element(arr.begin(), arr.end());
 }
 
-std::vector<unsigned char> bit_packing_encode(const std::vector<int>& arr) {
+void bit_packing_encode(const std::vector<int>& arr, BitOutBuffer& stream) {
     if (arr.empty()) {
-        return {};
+        return;
     }
 
     // Find maximum value and calculate bit width
     int max_val = find_max(arr);
     int bit_width = get_bit_width(max_val);
 
-    // Calculate total bits and bytes needed
-    int total_bits = arr.size() * bit_width;
-    int total_bytes = (total_bits + 7) / 8 + 1;  // +1 for bit_width byte
-
-    // Create binary string
-    std::string binary_string;
-    binary_string.reserve(total_bytes * 8);
-
-    // First byte: bit_width
-    for (int j = 7; j >= 0; j--) {
-        binary_string += '0' + ((bit_width >> j) & 1);
-    }
-
-    // Add all numbers
-    for (int val : arr) {
-        for (int j = bit_width - 1; j >= 0; j--) {
-            binary_string += '0' + ((val >> j) & 1);
+    // Width byte, then the values packed back to back and padded to a byte
+    stream.encode_8(bit_width);
+    if (bit_width > 0) {
+        for (int val : arr) {
+            stream.encode(val, bit_width);
         }
     }
+    stream.pack();
+}
 
-    // Pad with zeros
-    while ( (int) binary_string.length() < total_bytes * 8) {
-        binary_string += '0';
+std::vector<int> bit_packing_decode(BitInBuffer& stream, size_t original_length) {
+    if (original_length == 0) {
+        return {};
     }
 
-    // Convert to bytes
-    std::vector<unsigned char> result(total_bytes);
-    for (int i = 0; i < total_bytes; i++) {
-        unsigned char byte = 0;
-        for (int j = 0; j < 8; j++) {
-            byte = (byte << 1) | (binary_string[i * 8 + j] - '0');
-        }
-        result[i] = byte;
+    int bit_width = stream.decode_8();
+    if (bit_width > 32) {
+        throw std::runtime_error("Invalid bit width: " + std::to_string(bit_width));
+    }
+    uint64_t bit = stream.bit_offset();
+    size_t start = bit / 8;
+    unsigned first_bit = bit % 8;
+    size_t packed_bytes = bit_unpack_bytes(first_bit, bit_width, original_length);
+    if (packed_bytes > stream.size() - start) {
+        throw std::runtime_error("Bit packed data is shorter than " + std::to_string(original_length) + " values");
     }
 
+    // Unpack the values straight from the buffer into the result
+    std::vector<int> result(original_length);
+    bit_unpack(stream.data() + start, packed_bytes, first_bit, bit_width, original_length,
+               reinterpret_cast<uint32_t*>(result.data()));
+    stream.seek(start + packed_bytes);
     return result;
 }
 
+std::vector<unsigned char> bit_packing_encode(const std::vector<int>& arr) {
+    BitOutBuffer stream;
+    bit_packing_encode(arr, stream);
+    return stream.take_bytes();
+}
+
 std::vector<int> bit_packing_decode(const std::vector<unsigned char>& encoded, int original_length) {
     if (encoded.empty() || original_length <= 0) {
         return {};
     }
-
-    // Read bit_width directly from first byte
-    int bit_width = encoded[0];
-    
-    // Pre-allocate result vector
-    std::vector<int> result;
-    result.reserve(original_length);
-    
-    // Extract values directly from bytes without string conversion
-    // int bit_pos = 8;  // Start after bit_width byte
-    int byte_pos = 1; // Start from second byte
-    int bit_in_byte = 0;
-    
-    for (int i = 0; i < original_length; i++) {
-        int val = 0;
-        
-        // Read bit_width bits for this value
-        for (int j = 0; j < bit_width; j++) {
-            if (bit_in_byte >= 8) {
-                byte_pos++;
-                bit_in_byte = 0;
-            }
-            
-            int bit = (encoded[byte_pos] >> (7 - bit_in_byte)) & 1;
-            val = (val << 1) | bit;
-            bit_in_byte++;
-        }
-        
-        result.push_back(val);
-    }
-
-    return result;
+    BitInBuffer stream;
+    stream.attach(encoded.data(), encoded.size());
+    return bit_packing_decode(stream, original_length);
 }
 
 #ifdef BITPACKING_TEST
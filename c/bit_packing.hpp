@@ -3,6 +3,15 @@
 
 #include <vector>
 #include <string>
+#include "bit_buffer.hpp"
+
+// Write arr as its bit width (8 bits) followed by the values packed at that
+// width, most significant bit first, and pad to a byte. Nothing is written
+// for an empty arr.
+void bit_packing_encode(const std::vector<int>& arr, BitOutBuffer& stream);
+// Read original_length values written by bit_packing_encode, leaving the
+// stream after the padding
+std::vector<int> bit_packing_decode(BitInBuffer& stream, size_t original_length);
 
 // Function declarations
 std::vector<unsigned char> bit_packing_encode(const std::vector<int>& arr);
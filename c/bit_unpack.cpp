@@ -0,0 +1,282 @@
+#include "bit_unpack.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BIT_UNPACK_X86 1
+#endif
+
+using UnpackKernel = void (*)(const uint8_t* src, size_t src_size, unsigned first_bit,
+                              size_t count, uint32_t* out);
+
+// Big-endian 64-bit word at src[byte], zero filled past src_size
+static inline uint64_t load_be64(const uint8_t* src, size_t src_size, size_t byte) {
+    uint64_t word = 0;
+    if (byte + sizeof(word) <= src_size) {
+        std::memcpy(&word, src + byte, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return __builtin_bswap64(word);
+#else
+        return word;
+#endif
+    }
+    for (size_t i = 0; i < sizeof(word); i++) {
+        word = word << 8 | (byte + i < src_size ? src[byte + i] : 0);
+    }
+    return word;
+}
+
+// Values [begin, count) one at a time
+template <unsigned W>
+static void unpack_scalar_range(const uint8_t* src, size_t src_size, unsigned first_bit,
+                                size_t begin, size_t count, uint32_t* out) {
+    for (size_t i = begin; i < count; i++) {
+        uint64_t bit = first_bit + static_cast<uint64_t>(i) * W;
+        uint64_t word = load_be64(src, src_size, bit >> 3);
+        out[i] = static_cast<uint32_t>((word << (bit & 7)) >> (64 - W));
+    }
+}
+
+template <unsigned W>
+static void unpack_scalar(const uint8_t* src, size_t src_size, unsigned first_bit,
+                          size_t count, uint32_t* out) {
+    unpack_scalar_range<W>(src, src_size, first_bit, 0, count, out);
+}
+
+template <>
+void unpack_scalar<0>(const uint8_t*, size_t, unsigned, size_t count, uint32_t* out) {
+    std::memset(out, 0, count * sizeof(uint32_t));
+}
+
+#ifdef BIT_UNPACK_X86
+// Every 8 values of W bits span exactly W bytes, so a group of 8 values
+// always has the same layout. Values 0-3 of a group are gathered from the
+// 16 bytes at its start and values 4-7 from the 16 bytes at value 4's
+// first byte: a byte shuffle puts the 4 bytes holding each value into its
+// lane as a big-endian word, which is then shifted left by the value's bit
+// offset and right by 32 - W. This covers widths up to 25, where a value
+// and its offset fit in 4 bytes; wider values use the scalar kernel.
+struct GroupLayout {
+    uint8_t shuffle[32];     // Byte shuffle for values 0-3, then 4-7
+    uint32_t shift[8];       // Left shift of each value
+    uint32_t multiplier[8];  // 1 << shift, for SSE4.1 which has no variable shift
+    size_t high_offset;      // First byte of value 4
+    size_t safe_groups;      // Groups whose 16-byte loads stay inside src
+};
+
+static GroupLayout group_layout(size_t src_size, unsigned first_bit, unsigned width, size_t count) {
+    GroupLayout layout;
+    layout.high_offset = (first_bit + 4 * width) >> 3;
+    for (unsigned k = 0; k < 8; k++) {
+        unsigned bit = first_bit + k * width;
+        size_t byte = (bit >> 3) - (k < 4 ? 0 : layout.high_offset);
+        for (unsigned b = 0; b < 4; b++) {
+            layout.shuffle[k * 4 + b] = static_cast<uint8_t>(byte + 3 - b);
+        }
+        layout.shift[k] = bit & 7;
+        layout.multiplier[k] = 1u << (bit & 7);
+    }
+    size_t groups = count / 8;
+    size_t reach = layout.high_offset + 16;
+    layout.safe_groups = src_size < reach ? 0 : std::min(groups, (src_size - reach) / width + 1);
+    return layout;
+}
+
+template <unsigned W>
+__attribute__((target("avx2")))
+static void unpack_avx2(const uint8_t* src, size_t src_size, unsigned first_bit,
+                        size_t count, uint32_t* out) {
+    GroupLayout layout = group_layout(src_size, first_bit, W, count);
+    const __m256i shuffle = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(layout.shuffle));
+    const __m256i shift = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(layout.shift));
+    for (size_t g = 0; g < layout.safe_groups; g++) {
+        const uint8_t* base = src + g * W;
+        __m256i bytes = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + layout.high_offset)), 1);
+        __m256i words = _mm256_shuffle_epi8(bytes, shuffle);
+        __m256i values = _mm256_srli_epi32(_mm256_sllv_epi32(words, shift), 32 - W);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + g * 8), values);
+    }
+    unpack_scalar_range<W>(src, src_size, first_bit, layout.safe_groups * 8, count, out);
+}
+
+template <unsigned W>
+__attribute__((target("sse4.1")))
+static void unpack_sse41(const uint8_t* src, size_t src_size, unsigned first_bit,
+                         size_t count, uint32_t* out) {
+    GroupLayout layout = group_layout(src_size, first_bit, W, count);
+    const __m128i shuffle_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.shuffle));
+    const __m128i shuffle_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.shuffle + 16));
+    const __m128i multiplier_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.multiplier));
+    const __m128i multiplier_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.multiplier + 4));
+    for (size_t g = 0; g < layout.safe_groups; g++) {
+        const uint8_t* base = src + g * W;
+        __m128i low = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(base)), shuffle_low);
+        __m128i high = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(base + layout.high_offset)), shuffle_high);
+        low = _mm_srli_epi32(_mm_mullo_epi32(low, multiplier_low), 32 - W);
+        high = _mm_srli_epi32(_mm_mullo_epi32(high, multiplier_high), 32 - W);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + g * 8), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + g * 8 + 4), high);
+    }
+    unpack_scalar_range<W>(src, src_size, first_bit, layout.safe_groups * 8, count, out);
+}
+#endif
+
+constexpr unsigned MAX_WIDTH = 32;
+constexpr unsigned MAX_SIMD_WIDTH = 25;
+
+enum class UnpackIsa { SCALAR, SSE41, AVX2 };
+
+template <unsigned W>
+static UnpackKernel kernel_for(UnpackIsa isa) {
+#ifdef BIT_UNPACK_X86
+    if constexpr (W >= 1 && W <= MAX_SIMD_WIDTH) {
+        if (isa == UnpackIsa::AVX2) return &unpack_avx2<W>;
+        if (isa == UnpackIsa::SSE41) return &unpack_sse41<W>;
+    }
+#endif
+    (void)isa;
+    return &unpack_scalar<W>;
+}
+
+template <size_t... W>
+static void fill_kernels(UnpackKernel* kernels, UnpackIsa isa, std::index_sequence<W...>) {
+    ((kernels[W] = kernel_for<W>(isa)), ...);
+}
+
+// Kernels for the best instruction set of this CPU, indexed by bit width
+static const UnpackKernel* unpack_kernels() {
+    static const struct KernelTable {
+        UnpackKernel kernels[MAX_WIDTH + 1];
+        KernelTable() {
+            UnpackIsa isa = UnpackIsa::SCALAR;
+#ifdef BIT_UNPACK_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                isa = UnpackIsa::AVX2;
+            } else if (__builtin_cpu_supports("sse4.1")) {
+                isa = UnpackIsa::SSE41;
+            }
+#endif
+            fill_kernels(kernels, isa, std::make_index_sequence<MAX_WIDTH + 1>());
+        }
+    } table;
+    return table.kernels;
+}
+
+void bit_unpack(const uint8_t* src, size_t src_size, unsigned first_bit,
+                unsigned bit_width, size_t count, uint32_t* out) {
+    if (bit_width > MAX_WIDTH || first_bit > 7) {
+        throw std::invalid_argument("Invalid bit width: " + std::to_string(bit_width));
+    }
+    unpack_kernels()[bit_width](src, src_size, first_bit, count, out);
+}
+
+void delta_decode(uint32_t* values, size_t count, int32_t first, int32_t min_delta) {
+    // Unsigned arithmetic wraps the same way the encoder's int deltas did
+    uint32_t acc = static_cast<uint32_t>(first);
+    const uint32_t offset = static_cast<uint32_t>(min_delta);
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Prefix sum of 4 lanes with two shifted adds, carrying the last lane over
+    __m128i carry = _mm_set1_epi32(static_cast<int>(acc));
+    const __m128i offsets = _mm_set1_epi32(static_cast<int>(offset));
+    for (; i + 4 <= count; i += 4) {
+        __m128i* p = reinterpret_cast<__m128i*>(values + i);
+        __m128i x = _mm_add_epi32(_mm_loadu_si128(p), offsets);
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        _mm_storeu_si128(p, x);
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    acc = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+#endif
+    for (; i < count; i++) {
+        acc += values[i] + offset;
+        values[i] = acc;
+    }
+}
+
+#ifdef BIT_UNPACK_TEST
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Bit by bit, most significant first
+static uint32_t reference_value(const std::vector<uint8_t>& src, unsigned first_bit, unsigned width, size_t i) {
+    uint32_t value = 0;
+    for (unsigned b = 0; b < width; b++) {
+        uint64_t bit = first_bit + static_cast<uint64_t>(i) * width + b;
+        value = value << 1 | ((src[bit >> 3] >> (7 - (bit & 7))) & 1);
+    }
+    return value;
+}
+
+// Every kernel of isa against the reference, for all widths and offsets.
+// src holds exactly the bytes the values span, so the SIMD kernels also
+// have to stop their 16-byte loads before its end.
+static bool check_kernels(UnpackIsa isa, const char* name, std::mt19937& gen) {
+    UnpackKernel kernels[MAX_WIDTH + 1];
+    fill_kernels(kernels, isa, std::make_index_sequence<MAX_WIDTH + 1>());
+    for (unsigned width = 0; width <= MAX_WIDTH; width++) {
+        for (unsigned first_bit = 0; first_bit < 8; first_bit++) {
+            for (size_t count : {0, 1, 5, 8, 13, 16, 63, 100, 257}) {
+                std::vector<uint8_t> src(bit_unpack_bytes(first_bit, width, count));
+                for (auto& byte : src) byte = static_cast<uint8_t>(gen());
+                std::vector<uint32_t> out(count + 1, 0xDEADBEEF);
+                kernels[width](src.data(), src.size(), first_bit, count, out.data());
+                for (size_t i = 0; i < count; i++) {
+                    if (out[i] != reference_value(src, first_bit, width, i)) {
+                        std::cout << name << " kernel mismatch: width " << width << ", first bit "
+                                  << first_bit << ", count " << count << ", value " << i << std::endl;
+                        return false;
+                    }
+                }
+                if (out[count] != 0xDEADBEEF) {
+                    std::cout << name << " kernel wrote past count " << count << " at width " << width << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    std::cout << name << " kernels OK" << std::endl;
+    return true;
+}
+
+int main() {
+    std::mt19937 gen(7);
+    if (!check_kernels(UnpackIsa::SCALAR, "Scalar", gen)) return 1;
+#ifdef BIT_UNPACK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.1") && !check_kernels(UnpackIsa::SSE41, "SSE4.1", gen)) return 1;
+    if (__builtin_cpu_supports("avx2") && !check_kernels(UnpackIsa::AVX2, "AVX2", gen)) return 1;
+#endif
+
+    // delta_decode against a plain running sum, including wrap-around
+    for (size_t count : {0, 1, 3, 4, 5, 17}) {
+        std::vector<uint32_t> deltas(count);
+        for (auto& d : deltas) d = gen();
+        int32_t first = static_cast<int32_t>(gen());
+        int32_t min_delta = -static_cast<int32_t>(gen() % 1000);
+        std::vector<uint32_t> expected(count);
+        uint32_t acc = static_cast<uint32_t>(first);
+        for (size_t i = 0; i < count; i++) {
+            acc += deltas[i] + static_cast<uint32_t>(min_delta);
+            expected[i] = acc;
+        }
+        delta_decode(deltas.data(), count, first, min_delta);
+        if (deltas != expected) {
+            std::cout << "delta_decode mismatch for count " << count << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "delta_decode OK" << std::endl;
+    return 0;
+}
+#endif // BIT_UNPACK_TEST
@@ -0,0 +1,24 @@
+#ifndef BIT_UNPACK_HPP
+#define BIT_UNPACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// Unpack count values of bit_width (0 to 32) bits each, stored back to back
+// most significant bit first and starting first_bit (0 to 7) bits into src,
+// into out. Reads never go past src + src_size; the caller checks that the
+// values fit. Kernels are specialized per bit width, with AVX2 and SSE4.1
+// variants picked at runtime.
+void bit_unpack(const uint8_t* src, size_t src_size, unsigned first_bit,
+                unsigned bit_width, size_t count, uint32_t* out);
+
+// Turn count unpacked deltas into values in place: values[i] becomes
+// first + the sum of (values[j] + min_delta) for j <= i
+void delta_decode(uint32_t* values, size_t count, int32_t first, int32_t min_delta);
+
+// Bytes spanned by count values of bit_width bits starting first_bit into a byte
+inline size_t bit_unpack_bytes(unsigned first_bit, unsigned bit_width, size_t count) {
+    return (first_bit + static_cast<uint64_t>(bit_width) * count + 7) / 8;
+}
+
+#endif // BIT_UNPACK_HPP
@@ -1,86 +1,464 @@
 #include "distance.hpp"
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <map>
+#include <memory>
 #include <random>
 #include <unordered_map>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MINHASH_X86 1
+#endif
+
+constexpr size_t MINHASH_LANES = 4;  // 64-bit lanes of an AVX2 register
+
+// Fill out[j] with the minimum over the n shingle hashes x of
+// (a[j] * x + b[j]) >> 32, for lanes (a multiple of MINHASH_LANES) hash functions
+using MinHashKernel = void (*)(const uint32_t* shingles, size_t n, const uint64_t* a,
+                               const uint64_t* b, size_t lanes, uint32_t* out);
+
+static void min_hashes_scalar(const uint32_t* shingles, size_t n, const uint64_t* a,
+                              const uint64_t* b, size_t lanes, uint32_t* out) {
+    for (size_t j = 0; j < lanes; j++) {
+        uint32_t minimum = UINT32_MAX;
+        for (size_t i = 0; i < n; i++) {
+            minimum = std::min(minimum, static_cast<uint32_t>((a[j] * shingles[i] + b[j]) >> 32));
+        }
+        out[j] = minimum;
+    }
+}
+
+#ifdef MINHASH_X86
+// Four hash functions per register. The product of 64-bit a and 32-bit x
+// is built from two 32x32 multiplies, and only the high 32-bit half of
+// each 64-bit lane is kept, so an unsigned 32-bit minimum tracks it.
+__attribute__((target("avx2")))
+static void min_hashes_avx2(const uint32_t* shingles, size_t n, const uint64_t* a,
+                            const uint64_t* b, size_t lanes, uint32_t* out) {
+    const __m256i odd_lanes = _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7);
+    for (size_t j = 0; j < lanes; j += MINHASH_LANES) {
+        const __m256i a_low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + j));
+        const __m256i a_high = _mm256_srli_epi64(a_low, 32);
+        const __m256i bv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+        __m256i minimum = _mm256_set1_epi32(-1);
+        for (size_t i = 0; i < n; i++) {
+            const __m256i x = _mm256_set1_epi64x(shingles[i]);
+            __m256i h = _mm256_add_epi64(_mm256_mul_epu32(a_low, x),
+                                         _mm256_slli_epi64(_mm256_mul_epu32(a_high, x), 32));
+            minimum = _mm256_min_epu32(minimum, _mm256_add_epi64(h, bv));
+        }
+        __m256i packed = _mm256_permutevar8x32_epi32(minimum, odd_lanes);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), _mm256_castsi256_si128(packed));
+    }
+}
+#endif
+
+static MinHashKernel min_hash_kernel() {
+    static const MinHashKernel kernel = []() -> MinHashKernel {
+#ifdef MINHASH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return &min_hashes_avx2;
+#endif
+        return &min_hashes_scalar;
+    }();
+    return kernel;
+}
+
+// Write to matches[s] how many of the width values of signature s equal
+// those of query, for count signatures stored back to back
+template <typename T>
+using MatchKernel = void (*)(const T* signatures, size_t count, size_t width,
+                             const T* query, uint32_t* matches);
+
+template <typename T>
+static void count_matches_scalar(const T* signatures, size_t count, size_t width,
+                                 const T* query, uint32_t* matches) {
+    for (size_t s = 0; s < count; s++) {
+        const T* signature = signatures + s * width;
+        uint32_t m = 0;
+        for (size_t j = 0; j < width; j++) {
+            m += signature[j] == query[j];
+        }
+        matches[s] = m;
+    }
+}
+
+#ifdef MINHASH_X86
+// 32 bytes per compare. An equal value sets one movemask bit per byte, so
+// the popcount is divided by the value size at the end.
+template <typename T>
+__attribute__((target("avx2,popcnt")))
+static void count_matches_avx2(const T* signatures, size_t count, size_t width,
+                               const T* query, uint32_t* matches) {
+    constexpr size_t PER_VECTOR = 32 / sizeof(T);
+    size_t vector_width = width / PER_VECTOR * PER_VECTOR;
+    for (size_t s = 0; s < count; s++) {
+        const T* signature = signatures + s * width;
+        uint32_t bits = 0;
+        for (size_t j = 0; j < vector_width; j += PER_VECTOR) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(signature + j));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query + j));
+            __m256i equal;
+            if constexpr (sizeof(T) == 1) {
+                equal = _mm256_cmpeq_epi8(x, y);
+            } else if constexpr (sizeof(T) == 2) {
+                equal = _mm256_cmpeq_epi16(x, y);
+            } else {
+                equal = _mm256_cmpeq_epi32(x, y);
+            }
+            bits += __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(equal)));
+        }
+        uint32_t m = bits / sizeof(T);
+        for (size_t j = vector_width; j < width; j++) {
+            m += signature[j] == query[j];
+        }
+        matches[s] = m;
+    }
+}
+#endif
+
+template <typename T>
+static MatchKernel<T> match_kernel() {
+    static const MatchKernel<T> kernel = []() -> MatchKernel<T> {
+#ifdef MINHASH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return &count_matches_avx2<T>;
+#endif
+        return &count_matches_scalar<T>;
+    }();
+    return kernel;
+}
+
+// Write to distances[s] the number of bits fingerprint s differs from query in
+using HammingKernel = void (*)(const uint64_t* fingerprints, size_t count, uint64_t query,
+                               uint32_t* distances);
+
+static void hamming_distances_scalar(const uint64_t* fingerprints, size_t count, uint64_t query,
+                                     uint32_t* distances) {
+    for (size_t s = 0; s < count; s++) {
+        distances[s] = static_cast<uint32_t>(__builtin_popcountll(fingerprints[s] ^ query));
+    }
+}
+
+#ifdef MINHASH_X86
+// Same loop, but the popcount compiles to one instruction
+__attribute__((target("popcnt")))
+static void hamming_distances_popcnt(const uint64_t* fingerprints, size_t count, uint64_t query,
+                                     uint32_t* distances) {
+    for (size_t s = 0; s < count; s++) {
+        distances[s] = static_cast<uint32_t>(__builtin_popcountll(fingerprints[s] ^ query));
+    }
+}
+#endif
+
+static HammingKernel hamming_kernel() {
+    static const HammingKernel kernel = []() -> HammingKernel {
+#ifdef MINHASH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("popcnt")) return &hamming_distances_popcnt;
+#endif
+        return &hamming_distances_scalar;
+    }();
+    return kernel;
+}
+
+MinHash& MinHash::getInstance(int k, int numHashes) {
+    thread_local std::map<std::pair<int, int>, std::unique_ptr<MinHash>> instances;
+    std::unique_ptr<MinHash>& instance = instances[{k, numHashes}];
+    if (!instance) {
+        instance.reset(new MinHash(k, numHashes));
+    }
+    return *instance;
+}
+
 // Initialize MinHash with predefined hash function coefficients
-MinHash::MinHash(int k, int numHashes) : k_(k), numHashes_(numHashes) {
+MinHash::MinHash(int k, int numHashes) : k_(std::max(k, 1)), numHashes_(std::max(numHashes, 1)) {
     // Use fixed seed for generating hash function coefficients
     std::mt19937_64 gen(12345);
     std::uniform_int_distribution<uint64_t> dis;
     
-    a_.reserve(numHashes_);
-    b_.reserve(numHashes_);
-    for (int i = 0; i < numHashes_; i++) {
+    size_t lanes = (numHashes_ + MINHASH_LANES - 1) / MINHASH_LANES * MINHASH_LANES;
+    a_.reserve(lanes);
+    b_.reserve(lanes);
+    for (size_t i = 0; i < lanes; i++) {
         a_.push_back(dis(gen));
         b_.push_back(dis(gen));
     }
+    minimums_.resize(lanes);
+}
+
+void MinHash::getSignature(std::string_view str, uint32_t* out) {
+    // Hash every shingle of k bytes once (FNV-1a folded to 32 bits), then
+    // run all hash functions over the shingle hashes
+    shingles_.clear();
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(str.data());
+    for (size_t i = 0; i + k_ <= str.length(); ++i) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (int j = 0; j < k_; ++j) {
+            hash = (hash ^ data[i + j]) * 1099511628211ULL;
+        }
+        shingles_.push_back(static_cast<uint32_t>(hash ^ (hash >> 32)));
+    }
+    min_hash_kernel()(shingles_.data(), shingles_.size(), a_.data(), b_.data(), a_.size(), minimums_.data());
+    std::copy(minimums_.begin(), minimums_.begin() + numHashes_, out);
+}
+
+std::vector<uint32_t> MinHash::getSignature(std::string_view str) {
+    std::vector<uint32_t> signature(numHashes_);
+    getSignature(str, signature.data());
+    return signature;
 }
 
-uint64_t MinHash::hashFunction(const std::string& str, uint64_t a, uint64_t b) {
-    // Use faster hash function (DJB2)
-    uint64_t hash = 5381;
-    for (char c : str) {
-        hash = ((hash << 5) + hash) + c;
+double MinHash::estimateDistance(const uint32_t* sig1, const uint32_t* sig2) const {
+    int matches = 0;
+    for (int i = 0; i < numHashes_; i++) {
+        if (sig1[i] == sig2[i]) matches++;
     }
-    return (a * hash + b) % PRIME;
+    return 1.0 - static_cast<double>(matches) / numHashes_;
+}
+
+double MinHash::estimateDistance(const std::vector<uint32_t>& sig1, 
+                               const std::vector<uint32_t>& sig2) const {
+    return estimateDistance(sig1.data(), sig2.data());
 }
 
-std::vector<uint64_t> MinHash::getSignature(const std::string& str) {
-    // Check cache first
-    auto it = signature_cache_.find(str);
-    if (it != signature_cache_.end()) {
-        return it->second;
+MinHashWindow::MinHashWindow(size_t capacity, int k, int numHashes, int bits)
+    : minhash_(MinHash::getInstance(k, numHashes))
+    , capacity_(capacity)
+    , width_(minhash_.numHashes())
+    , bits_(validBits(bits) ? bits : DEFAULT_BITS)
+    , lines_(capacity)
+    , matches_(capacity)
+    , full_(width_) {
+    switch (bits_) {
+        case 8: allocate<uint8_t>(); break;
+        case 16: allocate<uint16_t>(); break;
+        default: allocate<uint32_t>(); break;
     }
+}
 
-    std::vector<uint64_t> signature(numHashes_, UINT64_MAX);
-    
-    // Check if string is too short
-    if ((int) str.length() < k_) {
-        signature_cache_[str] = signature;
-        return signature;
+template <typename T>
+void MinHashWindow::allocate() {
+    Signatures<T>& signatures = std::get<Signatures<T>>(signatures_);
+    signatures.slots.resize(capacity_ * width_);
+    signatures.incoming.resize(width_);
+}
+
+// Sign line and keep the low bits of each value
+template <typename T>
+void MinHashWindow::sign(std::string_view line, T* out) {
+    minhash_.getSignature(line, full_.data());
+    for (size_t j = 0; j < width_; j++) {
+        out[j] = static_cast<T>(full_[j]);
     }
+}
 
-    // Use direct pointer access with bounds checking
-    const char* data = str.data();
-    const size_t len = str.length();
-    
-    try {
-        for (int i = 0; i + k_ <= (int) len; ++i) {
-            // Calculate base hash without creating new strings
-            uint64_t base_hash = 5381;
-            for (int j = 0; j < k_; ++j) {
-                base_hash = ((base_hash << 5) + base_hash) + 
-                           static_cast<unsigned char>(data[i + j]);
+template <typename T>
+void MinHashWindow::compare(std::string_view line) {
+    Signatures<T>& signatures = std::get<Signatures<T>>(signatures_);
+    sign(line, signatures.incoming.data());
+    // Slots in use are always [0, count_), the ring only wraps once it is full
+    match_kernel<T>()(signatures.slots.data(), count_, width_, signatures.incoming.data(), matches_.data());
+}
+
+template <typename T>
+void MinHashWindow::store(std::string_view line, size_t slot) {
+    Signatures<T>& signatures = std::get<Signatures<T>>(signatures_);
+    T* out = signatures.slots.data() + slot * width_;
+    if (has_incoming_ && line.data() == incoming_line_.data() && line.size() == incoming_line_.size()) {
+        std::copy(signatures.incoming.begin(), signatures.incoming.end(), out);
+    } else {
+        sign(line, out);
+    }
+}
+
+double MinHashWindow::distanceFor(uint32_t matches) const {
+    double agreement = static_cast<double>(matches) / width_;
+    if (bits_ < 32) {
+        // Unbiased Jaccard estimate of b-bit MinHash: values of dissimilar
+        // lines still agree with probability 2^-bits. At 32 bits that chance
+        // is negligible and the plain estimate is kept.
+        double chance = 1.0 / static_cast<double>(1u << bits_);
+        agreement = std::max(0.0, (agreement - chance) / (1.0 - chance));
+    }
+    return 1.0 - agreement;
+}
+
+int MinHashWindow::nearest(std::string_view line, double& distance) {
+    int best = -1;
+    distance = 1.0;
+    incoming_line_ = line;
+    has_incoming_ = !isShort(line);
+
+    if (!has_incoming_) {
+        // Lines without a full shingle only match themselves
+        for (size_t i = 0; i < count_; i++) {
+            if (lines_[(head_ + i) % capacity_] == line) {
+                distance = 0.0;
+                return static_cast<int>(i);
             }
-            
-            // Update all hash functions in one pass
-            for (int j = 0; j < numHashes_; j++) {
-                uint64_t current_hash = (a_[j] * base_hash + b_[j]) % PRIME;
-                signature[j] = std::min(signature[j], current_hash);
+        }
+        return -1;
+    }
+
+    // Compare against every slot in one pass
+    switch (bits_) {
+        case 8: compare<uint8_t>(line); break;
+        case 16: compare<uint16_t>(line); break;
+        default: compare<uint32_t>(line); break;
+    }
+    uint32_t best_matches = 0;
+    for (size_t i = 0; i < count_; i++) {
+        size_t slot = (head_ + i) % capacity_;
+        if (matches_[slot] > best_matches && !isShort(lines_[slot])) {
+            best_matches = matches_[slot];
+            best = static_cast<int>(i);
+        }
+    }
+    if (best >= 0) {
+        distance = distanceFor(best_matches);
+        if (distance >= 1.0) {
+            distance = 1.0;
+            best = -1;
+        }
+    }
+    return best;
+}
+
+void MinHashWindow::push(std::string_view line) {
+    if (capacity_ == 0) return;
+    size_t slot = (head_ + count_) % capacity_;
+    if (count_ < capacity_) {
+        count_++;
+    } else {
+        head_ = (head_ + 1) % capacity_;
+    }
+    lines_[slot] = line;
+    if (isShort(line)) return;  // Compared by content only
+    switch (bits_) {
+        case 8: store<uint8_t>(line, slot); break;
+        case 16: store<uint16_t>(line, slot); break;
+        default: store<uint32_t>(line, slot); break;
+    }
+}
+
+// Byte i of SPREAD[v] is bit i of v, so adding SPREAD entries counts set
+// bits in 8 byte lanes at once
+static const std::array<uint64_t, 256> SPREAD = []() {
+    std::array<uint64_t, 256> spread{};
+    for (int v = 0; v < 256; v++) {
+        for (int i = 0; i < 8; i++) {
+            spread[v] |= static_cast<uint64_t>((v >> i) & 1) << (8 * i);
+        }
+    }
+    return spread;
+}();
+
+uint64_t SimHash::fingerprint(std::string_view str, int q) {
+    q = std::max(q, 1);
+    // A bit's votes are positive when it is set in more than half of the
+    // q-gram hashes, so only the set bits are counted: 8 bits per add in
+    // byte lanes, spilled to wider counters before a lane can overflow
+    uint32_t counts[BITS] = {};
+    uint64_t lanes[BITS / 8] = {};
+    size_t pending = 0;
+    auto spill = [&]() {
+        for (int byte = 0; byte < BITS / 8; byte++) {
+            for (int i = 0; i < 8; i++) {
+                counts[byte * 8 + i] += (lanes[byte] >> (8 * i)) & 0xFF;
             }
+            lanes[byte] = 0;
+        }
+        pending = 0;
+    };
+
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(str.data());
+    size_t shingles = 0;
+    for (size_t i = 0; i + q <= str.length(); ++i, ++shingles) {
+        // FNV-1a, with a final mix so that every bit depends on every byte
+        uint64_t hash = 14695981039346656037ULL;
+        for (int j = 0; j < q; ++j) {
+            hash = (hash ^ data[i + j]) * 1099511628211ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        for (int byte = 0; byte < BITS / 8; byte++) {
+            lanes[byte] += SPREAD[(hash >> (8 * byte)) & 0xFF];
         }
-    } catch (const std::exception& e) {
-        // If any error occurs, return the default signature
-        return signature;
+        if (++pending == 255) spill();
     }
+    spill();
 
-    // Cache the result
-    signature_cache_[str] = signature;
-    return signature;
+    uint64_t fp = 0;
+    for (int b = 0; b < BITS; b++) {
+        fp |= static_cast<uint64_t>(2 * static_cast<size_t>(counts[b]) > shingles) << b;
+    }
+    return fp;
 }
 
-double MinHash::estimateDistance(const std::vector<uint64_t>& sig1, 
-                               const std::vector<uint64_t>& sig2) {
-    int matches = 0;
-    for (int i = 0; i < numHashes_; i++) {
-        if (sig1[i] == sig2[i]) matches++;
+SimHashWindow::SimHashWindow(size_t capacity, int q)
+    : q_(std::max(q, 1))
+    , capacity_(capacity)
+    , fingerprints_(capacity)
+    , lines_(capacity)
+    , distances_(capacity) {}
+
+int SimHashWindow::nearest(std::string_view line, double& distance) {
+    int best = -1;
+    distance = 1.0;
+    incoming_line_ = line;
+    has_incoming_ = !isShort(line);
+
+    if (!has_incoming_) {
+        // Lines without a full q-gram only match themselves
+        for (size_t i = 0; i < count_; i++) {
+            if (lines_[(head_ + i) % capacity_] == line) {
+                distance = 0.0;
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Slots in use are always [0, count_), the ring only wraps once it is full
+    incoming_ = SimHash::fingerprint(line, q_);
+    hamming_kernel()(fingerprints_.data(), count_, incoming_, distances_.data());
+    uint32_t best_bits = SimHash::BITS;
+    for (size_t i = 0; i < count_; i++) {
+        size_t slot = (head_ + i) % capacity_;
+        if (distances_[slot] < best_bits && !isShort(lines_[slot])) {
+            best_bits = distances_[slot];
+            best = static_cast<int>(i);
+        }
+    }
+    if (best >= 0) {
+        distance = static_cast<double>(best_bits) / SimHash::BITS;
+    }
+    return best;
+}
+
+void SimHashWindow::push(std::string_view line) {
+    if (capacity_ == 0) return;
+    size_t slot = (head_ + count_) % capacity_;
+    if (count_ < capacity_) {
+        count_++;
+    } else {
+        head_ = (head_ + 1) % capacity_;
+    }
+    lines_[slot] = line;
+    if (isShort(line)) return;  // Compared by content only
+    if (has_incoming_ && line.data() == incoming_line_.data() && line.size() == incoming_line_.size()) {
+        fingerprints_[slot] = incoming_;
+    } else {
+        fingerprints_[slot] = SimHash::fingerprint(line, q_);
     }
-    return 1.0 - static_cast<double>(matches) / numHashes_;
 }
 
-double Distance::minHashDistance(const std::string& str1, const std::string& str2, int k, int numHashes) {
-    static MinHash& minhash = MinHash::getInstance();
+double Distance::minHashDistance(std::string_view str1, std::string_view str2, int k, int numHashes) {
+    MinHash& minhash = MinHash::getInstance(k, numHashes);
     
     // If strings are identical, return 0.0 immediately
     if (str1 == str2) return 0.0;
@@ -91,29 +469,29 @@ double Distance::minHashDistance(const std::string& str1, const std::string& str
         return 1.0;
     }
     
-    try {
-        auto sig1 = minhash.getSignature(str1);
-        auto sig2 = minhash.getSignature(str2);
-        return minhash.estimateDistance(sig1, sig2);
-    } catch (const std::exception& e) {
-        return 1.0;  // Return maximum distance on error
-    }
+    return minhash.estimateDistance(minhash.getSignature(str1), minhash.getSignature(str2));
+}
+
+double Distance::simHashDistance(std::string_view str1, std::string_view str2, int q) {
+    if (str1 == str2) return 0.0;
+    if ((int) str1.length() < q || (int) str2.length() < q) return 1.0;
+    return SimHash::distance(SimHash::fingerprint(str1, q), SimHash::fingerprint(str2, q));
 }
 
-std::unordered_map<std::string, int> Distance::generateQgrams(const std::string& str, int q) {
-    std::unordered_map<std::string, int> qgrams;
+std::unordered_map<std::string_view, int> Distance::generateQgrams(std::string_view str, int q) {
+    std::unordered_map<std::string_view, int> qgrams;
     
     if ((int) str.length() < q) return qgrams;
     // Generate q-grams using sliding window
     for (int i = 0; i <= (int) str.length() - q; ++i) {
-        std::string qgram = str.substr(i, q);
+        std::string_view qgram = str.substr(i, q);
         qgrams[qgram]++;
     }
     
     return qgrams;
 }
 
-double Distance::qgramCosineDistance(const std::string& str1, const std::string& str2, int q) {
+double Distance::qgramCosineDistance(std::string_view str1, std::string_view str2, int q) {
     // Generate q-gram vectors for both strings
     auto qgrams1 = generateQgrams(str1, q);
     auto qgrams2 = generateQgrams(str2, q);
@@ -121,7 +499,7 @@ double Distance::qgramCosineDistance(const std::string& str1, const std::string&
     // Calculate dot product
     double dotProduct = 0.0;
     for (const auto& pair : qgrams1) {
-        const std::string& qgram = pair.first;
+        std::string_view qgram = pair.first;
         int count = pair.second;
         if (qgrams2.count(qgram) > 0) {
             dotProduct += count * qgrams2[qgram];
@@ -153,7 +531,7 @@ double Distance::qgramCosineDistance(const std::string& str1, const std::string&
     return 1.0 - similarity; // Convert similarity to distance
 }
 
-double Distance::calculateDistance(const std::string& str1, const std::string& str2, 
+double Distance::calculateDistance(std::string_view str1, std::string_view str2, 
                                  DistanceType distance_type, int q) {
     switch (distance_type) {
         case DistanceType::COSINE:
@@ -167,17 +545,73 @@ double Distance::calculateDistance(const std::string& str1, const std::string& s
             // Return min(distance/max_length, 1.0) to ensure result is in [0,1]
             return std::min(1.0, static_cast<double>(distance) / max_length);
         }
+        case DistanceType::SIMHASH:
+            return simHashDistance(str1, str2, q);
         default:
             return 1.0;
     }
 }
 
 #ifdef DISTANCE_TEST
+#include <iostream>
+
+template <typename T>
+static bool check_match_kernel(std::mt19937_64& gen) {
+    for (size_t width : {1, 8, 50, 70}) {
+        std::vector<T> signatures(64 * width), query(width);
+        for (auto& v : signatures) v = static_cast<T>(gen() % 3);
+        for (auto& v : query) v = static_cast<T>(gen() % 3);
+        std::vector<uint32_t> expected(64), actual(64);
+        count_matches_scalar<T>(signatures.data(), 64, width, query.data(), expected.data());
+        match_kernel<T>()(signatures.data(), 64, width, query.data(), actual.data());
+        if (expected != actual) {
+            std::cout << "Match kernel mismatch for " << sizeof(T) * 8 << "-bit width " << width << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
 int main() {
     std::string str1 = "Jun  9 06:06:51 combo anacron: anacron startup succeeded";
     std::string str2 = "Jun  9 06:06:51 combo atd: atd startup succeeded";
     double distance = Distance::qgramCosineDistance(str1, str2, 3);
     std::cout << distance << std::endl;
+    std::cout << Distance::minHashDistance(str1, str2) << std::endl;
+    std::cout << Distance::simHashDistance(str1, str2) << std::endl;
+
+    // The selected kernel must agree with the scalar one
+    std::mt19937_64 gen(1);
+    for (size_t n : {0, 1, 7, 100}) {
+        std::vector<uint32_t> shingles(n);
+        for (auto& x : shingles) x = static_cast<uint32_t>(gen());
+        std::vector<uint64_t> a(52), b(52);
+        for (size_t j = 0; j < a.size(); j++) {
+            a[j] = gen();
+            b[j] = gen();
+        }
+        std::vector<uint32_t> expected(a.size()), actual(a.size());
+        min_hashes_scalar(shingles.data(), n, a.data(), b.data(), a.size(), expected.data());
+        min_hash_kernel()(shingles.data(), n, a.data(), b.data(), a.size(), actual.data());
+        if (expected != actual) {
+            std::cout << "MinHash kernel mismatch for " << n << " shingles" << std::endl;
+            return 1;
+        }
+    }
+    if (!check_match_kernel<uint8_t>(gen) || !check_match_kernel<uint16_t>(gen) ||
+        !check_match_kernel<uint32_t>(gen)) {
+        return 1;
+    }
+    std::vector<uint64_t> fingerprints(100);
+    for (auto& fp : fingerprints) fp = gen();
+    uint64_t query = gen();
+    std::vector<uint32_t> expected_bits(100), actual_bits(100);
+    hamming_distances_scalar(fingerprints.data(), 100, query, expected_bits.data());
+    hamming_kernel()(fingerprints.data(), 100, query, actual_bits.data());
+    if (expected_bits != actual_bits) {
+        std::cout << "Hamming kernel mismatch" << std::endl;
+        return 1;
+    }
     return 0;
 }
-#endif // DISTANCE_TEST
\ No newline at end of file
+#endif // DISTANCE_TEST
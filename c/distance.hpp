@@ -1,54 +1,182 @@
 #ifndef DISTANCE_HPP
 #define DISTANCE_HPP
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 #include "qgram_match.hpp"
 
 class MinHash {
 public:
-    static MinHash& getInstance() {
-        static MinHash instance(3, 50);  // 减少哈希函数数量到50个
-        return instance;
-    }
+    static constexpr int DEFAULT_K = 3;
+    static constexpr int DEFAULT_NUM_HASHES = 50;
+
+    // One instance per thread and per (k, numHashes), so parallel matchers
+    // never share scratch buffers
+    static MinHash& getInstance(int k = DEFAULT_K, int numHashes = DEFAULT_NUM_HASHES);
     
-    std::vector<uint64_t> getSignature(const std::string& str);
-    double estimateDistance(const std::vector<uint64_t>& sig1, 
-                          const std::vector<uint64_t>& sig2);
-    void clearCache() { signature_cache_.clear(); }  // Clear cache when needed
+    // Write the signature of str, numHashes() values, to out
+    void getSignature(std::string_view str, uint32_t* out);
+    std::vector<uint32_t> getSignature(std::string_view str);
+    double estimateDistance(const uint32_t* sig1, const uint32_t* sig2) const;
+    double estimateDistance(const std::vector<uint32_t>& sig1, 
+                          const std::vector<uint32_t>& sig2) const;
+
+    int k() const { return k_; }
+    int numHashes() const { return numHashes_; }
 
 private:
     MinHash(int k, int numHashes);
     int k_;
     int numHashes_;
-    std::vector<uint64_t> a_;  // 固定的哈希函数系数
+    // Hash function j maps the 32-bit hash x of a shingle to the high half
+    // of a_[j] * x + b_[j] (mod 2^64), Dietzfelbinger's multiply-add-shift
+    // scheme, which is 2-independent without any division. The coefficients
+    // are padded to a multiple of 4 so SIMD kernels cover whole registers.
+    std::vector<uint64_t> a_;
     std::vector<uint64_t> b_;
-    static constexpr uint64_t PRIME = 1099511628211ULL;
-    uint64_t hashFunction(const std::string& str, uint64_t a, uint64_t b);
-    
-    // Cache for string signatures
-    std::unordered_map<std::string, std::vector<uint64_t>> signature_cache_;
+    std::vector<uint32_t> shingles_;  // Shingle hashes of the line being signed
+    std::vector<uint32_t> minimums_;  // Padded signature of the line being signed
+};
+
+// MinHash signatures of the most recent lines, one fixed-size slot per
+// line, so scanning the window compares precomputed signatures instead of
+// hashing lines again. Every line is signed once, when it is looked up or
+// pushed. The slots are one slot-major matrix, compared against a new line
+// by a single SIMD pass. They form a ring like LineWindow's, index 0 being
+// the oldest line, and the lines are owned by the caller.
+//
+// Signatures can keep only the low bits (8 or 16) of every hash, b-bit
+// MinHash: the window then takes 2 or 4 times less memory and every
+// compare covers 2 or 4 times more hashes. Two unrelated values then agree
+// with probability 2^-bits, which distances correct for.
+class MinHashWindow {
+public:
+    static constexpr int DEFAULT_BITS = 32;
+    static bool validBits(int bits) { return bits == 8 || bits == 16 || bits == 32; }
+
+    MinHashWindow(size_t capacity, int k = MinHash::DEFAULT_K, int numHashes = MinHash::DEFAULT_NUM_HASHES,
+                  int bits = DEFAULT_BITS);
+
+    // Index of the window line closest to line and its estimated distance.
+    // With 32-bit values this is the same as Distance::minHashDistance. The
+    // oldest line wins ties; returns -1 and a distance of 1.0 if no line is
+    // closer than that.
+    int nearest(std::string_view line, double& distance);
+    // Add the newest line, dropping the oldest one when the window is full.
+    // Reuses the signature of the last line passed to nearest().
+    void push(std::string_view line);
+
+    size_t size() const { return count_; }
+    void clear() {
+        head_ = 0;
+        count_ = 0;
+    }
+
+private:
+    MinHash& minhash_;
+    size_t capacity_;
+    size_t width_;       // Values per signature
+    int bits_;           // Bits per value
+    size_t head_ = 0;    // Slot of the oldest line
+    size_t count_ = 0;
+    // Signatures with values of type T
+    template <typename T>
+    struct Signatures {
+        std::vector<T> slots;     // capacity_ slots of width_ values, back to back
+        std::vector<T> incoming;  // Signature of the last line passed to nearest()
+    };
+    // Only the member whose value type has bits_ bits is allocated
+    std::tuple<Signatures<uint8_t>, Signatures<uint16_t>, Signatures<uint32_t>> signatures_;
+    std::vector<std::string_view> lines_;  // Line of each slot
+    std::vector<uint32_t> matches_;        // Values each slot shares with the incoming line
+    std::vector<uint32_t> full_;           // 32-bit signature of the line being signed
+    std::string_view incoming_line_;
+    bool has_incoming_ = false;
+
+    bool isShort(std::string_view line) const { return line.length() < static_cast<size_t>(minhash_.k()); }
+    template <typename T> void allocate();
+    template <typename T> void sign(std::string_view line, T* out);
+    template <typename T> void compare(std::string_view line);   // Sign line as incoming, count matches
+    template <typename T> void store(std::string_view line, size_t slot);
+    double distanceFor(uint32_t matches) const;
+};
+
+// 64-bit SimHash fingerprints of a line's q-grams. Every q-gram votes on
+// each bit with the matching bit of its hash, a q-gram that occurs several
+// times voting once per occurrence, and a bit is set when its votes are
+// positive. The fraction of differing bits estimates the angle between the
+// q-gram count vectors over pi, so two lines compare with one popcount.
+class SimHash {
+public:
+    static constexpr int BITS = 64;
+
+    static uint64_t fingerprint(std::string_view str, int q = 3);
+    static double distance(uint64_t fp1, uint64_t fp2) {
+        return static_cast<double>(__builtin_popcountll(fp1 ^ fp2)) / BITS;
+    }
+};
+
+// SimHash fingerprints of the most recent lines, the SimHash counterpart
+// of MinHashWindow: each line is fingerprinted once and the window scan is
+// one popcount per line.
+class SimHashWindow {
+public:
+    explicit SimHashWindow(size_t capacity, int q = 3);
+
+    // Index of the window line closest to line and its estimated distance,
+    // the same as Distance::simHashDistance. The oldest line wins ties;
+    // returns -1 and a distance of 1.0 if no line is closer than that.
+    int nearest(std::string_view line, double& distance);
+    // Add the newest line, dropping the oldest one when the window is full.
+    // Reuses the fingerprint of the last line passed to nearest().
+    void push(std::string_view line);
+
+    size_t size() const { return count_; }
+    void clear() {
+        head_ = 0;
+        count_ = 0;
+    }
+
+private:
+    int q_;
+    size_t capacity_;
+    size_t head_ = 0;    // Slot of the oldest line
+    size_t count_ = 0;
+    std::vector<uint64_t> fingerprints_;   // Fingerprint of each slot
+    std::vector<std::string_view> lines_;  // Line of each slot
+    std::vector<uint32_t> distances_;      // Bits each slot differs from the incoming line in
+    uint64_t incoming_ = 0;                // Fingerprint of the last line passed to nearest()
+    std::string_view incoming_line_;
+    bool has_incoming_ = false;
+
+    bool isShort(std::string_view line) const { return line.length() < static_cast<size_t>(q_); }
 };
 
 // 添加距离函数类型的枚举
 enum class DistanceType {
     COSINE,     // Q-gram cosine distance
     MINHASH,    // MinHash distance
-    QGRAM       // Q-gram match distance
+    QGRAM,      // Q-gram match distance
+    SIMHASH     // SimHash distance
 };
 
 class Distance {
 public:
     // Generate q-gram vector for a string
-    static std::unordered_map<std::string, int> generateQgrams(const std::string& str, int q = 3);
+    static std::unordered_map<std::string_view, int> generateQgrams(std::string_view str, int q = 3);
 
     // Calculate distances between two strings
-    static double qgramCosineDistance(const std::string& str1, const std::string& str2, int q = 3);
-    static double minHashDistance(const std::string& str1, const std::string& str2, int k = 3, int numHashes = 50);
+    static double qgramCosineDistance(std::string_view str1, std::string_view str2, int q = 3);
+    static double minHashDistance(std::string_view str1, std::string_view str2, int k = MinHash::DEFAULT_K,
+                                  int numHashes = MinHash::DEFAULT_NUM_HASHES);
+    static double simHashDistance(std::string_view str1, std::string_view str2, int q = 3);
     
     // 添加通用的距离计算函数
-    static double calculateDistance(const std::string& str1, const std::string& str2, 
+    static double calculateDistance(std::string_view str1, std::string_view str2, 
                                   DistanceType distance_type, int q = 3);
 };
 
@@ -0,0 +1,225 @@
+#include "int_codec.hpp"
+#include "bit_packing.hpp"
+#include "rle.hpp"
+#include "ts_2diff.hpp"
+#include "varint.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+const char* int_codec_name(IntCodec codec) {
+    switch (codec) {
+        case IntCodec::BIT_PACKING: return "bitpack";
+        case IntCodec::TS2DIFF: return "ts2diff";
+        case IntCodec::PFOR: return "pfor";
+        case IntCodec::VARINT: return "varint";
+        case IntCodec::RLE: return "rle";
+        case IntCodec::DELTA_OF_DELTA: return "delta-of-delta";
+        default: return "unknown";
+    }
+}
+
+bool int_codec_supports(IntCodec codec, const std::vector<int>& values) {
+    switch (codec) {
+        case IntCodec::BIT_PACKING:
+            return std::all_of(values.begin(), values.end(), [](int value) { return value >= 0; });
+        case IntCodec::TS2DIFF:
+        case IntCodec::PFOR:
+        case IntCodec::VARINT:
+        case IntCodec::RLE:
+        case IntCodec::DELTA_OF_DELTA:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void rle_encode_values(const std::vector<int>& values, BitOutBuffer& stream) {
+    std::vector<uint64_t> runs = findRuns(values);
+    std::vector<int> run_values;
+    run_values.reserve(runs.size());
+    size_t position = 0;
+    for (uint64_t run : runs) {
+        run_values.push_back(values[position]);
+        position += run;
+    }
+    stream.encode_32(runs.size());
+    pfor_encode(run_values, stream, 0);
+    for (uint64_t run : runs) {
+        encodeRun(run, stream);
+    }
+    stream.pack();
+}
+
+static std::vector<int> rle_decode_values(BitInBuffer& stream, size_t count) {
+    size_t run_count = stream.decode_32();
+    if (run_count > count) {
+        throw std::runtime_error("Invalid RLE run count: " + std::to_string(run_count));
+    }
+    std::vector<int> run_values = pfor_decode(stream, run_count, 0);
+    std::vector<int> result;
+    result.reserve(count);
+    for (int value : run_values) {
+        uint64_t run = decodeRun(stream);
+        if (run == 0 || run > count - result.size()) {
+            throw std::runtime_error("Invalid RLE run length: " + std::to_string(run));
+        }
+        result.insert(result.end(), run, value);
+    }
+    if (result.size() != count) {
+        throw std::runtime_error("RLE runs cover " + std::to_string(result.size()) +
+                                 " of " + std::to_string(count) + " values");
+    }
+    stream.align();
+    return result;
+}
+
+void int_codec_encode(IntCodec codec, const std::vector<int>& values, BitOutBuffer& stream) {
+    if (!int_codec_supports(codec, values)) {
+        throw std::invalid_argument(std::string("Values not supported by integer codec ") + int_codec_name(codec));
+    }
+    stream.encode_32(values.size());
+    if (values.empty()) return;
+    switch (codec) {
+        case IntCodec::BIT_PACKING: bit_packing_encode(values, stream); break;
+        case IntCodec::TS2DIFF: pfor_encode(values, stream, 1); break;
+        case IntCodec::PFOR: pfor_encode(values, stream, 0); break;
+        case IntCodec::VARINT: varint_encode(values, stream); break;
+        case IntCodec::RLE: rle_encode_values(values, stream); break;
+        case IntCodec::DELTA_OF_DELTA: pfor_encode(values, stream, 2); break;
+        default: break;
+    }
+}
+
+std::vector<int> int_codec_decode(IntCodec codec, BitInBuffer& stream) {
+    size_t count = stream.decode_32();
+    if (count == 0) return {};
+    switch (codec) {
+        case IntCodec::BIT_PACKING: return bit_packing_decode(stream, count);
+        case IntCodec::TS2DIFF: return pfor_decode(stream, count, 1);
+        case IntCodec::PFOR: return pfor_decode(stream, count, 0);
+        case IntCodec::VARINT: return varint_decode(stream, count);
+        case IntCodec::RLE: return rle_decode_values(stream, count);
+        case IntCodec::DELTA_OF_DELTA: return pfor_decode(stream, count, 2);
+        default:
+            throw std::runtime_error("Invalid integer codec: " + std::to_string(static_cast<int>(codec)));
+    }
+}
+
+IntCodec int_codec_encode_best(const std::vector<int>& values, BitOutBuffer& stream) {
+    IntCodec best = IntCodec::COUNT;
+    std::vector<uint8_t> best_bytes;
+    for (int c = 0; c < static_cast<int>(IntCodec::COUNT); c++) {
+        IntCodec codec = static_cast<IntCodec>(c);
+        if (!int_codec_supports(codec, values)) continue;
+        BitOutBuffer candidate;
+        int_codec_encode(codec, values, candidate);
+        std::vector<uint8_t> bytes = candidate.take_bytes();
+        if (best == IntCodec::COUNT || bytes.size() < best_bytes.size()) {
+            best = codec;
+            best_bytes.swap(bytes);
+        }
+    }
+    stream.append_bytes(best_bytes.data(), best_bytes.size());
+    return best;
+}
+
+#ifdef INT_CODEC_TEST
+#include <climits>
+#include <iostream>
+#include <random>
+
+static std::vector<uint8_t> encode_column(IntCodec codec, const std::vector<int>& values) {
+    BitOutBuffer stream;
+    int_codec_encode(codec, values, stream);
+    return stream.take_bytes();
+}
+
+// Round trip values through every codec that supports them, two columns
+// back to back so each decoder has to stop at the end of its own column
+static bool check_column(const std::string& name, const std::vector<int>& values) {
+    for (int c = 0; c < static_cast<int>(IntCodec::COUNT); c++) {
+        IntCodec codec = static_cast<IntCodec>(c);
+        if (!int_codec_supports(codec, values)) {
+            try {
+                encode_column(codec, values);
+                std::cout << name << ": " << int_codec_name(codec) << " accepted unsupported values" << std::endl;
+                return false;
+            } catch (const std::invalid_argument&) {
+            }
+            continue;
+        }
+        BitOutBuffer out;
+        int_codec_encode(codec, values, out);
+        int_codec_encode(codec, values, out);
+        std::vector<uint8_t> bytes = out.take_bytes();
+        BitInBuffer in;
+        in.attach(bytes.data(), bytes.size());
+        std::vector<int> first = int_codec_decode(codec, in);
+        std::vector<int> second = int_codec_decode(codec, in);
+        if (first != values || second != values || in.byte_offset() != bytes.size()) {
+            std::cout << name << ": " << int_codec_name(codec) << " round trip failed" << std::endl;
+            return false;
+        }
+    }
+
+    // The chosen encoding must be the shortest and decode with its codec
+    BitOutBuffer out;
+    IntCodec best = int_codec_encode_best(values, out);
+    std::vector<uint8_t> bytes = out.take_bytes();
+    for (int c = 0; c < static_cast<int>(IntCodec::COUNT); c++) {
+        IntCodec codec = static_cast<IntCodec>(c);
+        if (int_codec_supports(codec, values) && encode_column(codec, values).size() < bytes.size()) {
+            std::cout << name << ": " << int_codec_name(best) << " picked over shorter "
+                      << int_codec_name(codec) << std::endl;
+            return false;
+        }
+    }
+    BitInBuffer in;
+    in.attach(bytes.data(), bytes.size());
+    if (int_codec_decode(best, in) != values) {
+        std::cout << name << ": best codec " << int_codec_name(best) << " round trip failed" << std::endl;
+        return false;
+    }
+    std::cout << name << ": " << values.size() << " values, best " << int_codec_name(best)
+              << " (" << bytes.size() << " bytes)" << std::endl;
+    return true;
+}
+
+int main() {
+    std::mt19937 gen(17);
+    std::vector<std::pair<std::string, std::vector<int>>> columns;
+    columns.push_back({"empty", {}});
+    columns.push_back({"single", {42}});
+    columns.push_back({"single negative", {-7}});
+    columns.push_back({"all equal", std::vector<int>(1000, 5)});
+    columns.push_back({"extremes", {INT_MIN, INT_MAX, 0, -1, INT_MIN, INT_MAX, 1, INT_MIN}});
+
+    std::vector<int> negative(500);
+    for (auto& v : negative) v = -static_cast<int>(gen() % 100000);
+    columns.push_back({"negative", negative});
+
+    std::vector<int> runs;
+    while (runs.size() < 5000) runs.insert(runs.end(), 1 + gen() % 200, static_cast<int>(gen() % 4));
+    columns.push_back({"runs", runs});
+
+    std::vector<int> timestamps(3000);
+    int t = 1700000000;
+    for (auto& v : timestamps) v = t += 1000 + gen() % 3;
+    columns.push_back({"timestamps", timestamps});
+
+    // Every byte count, to cover all Stream VByte shuffles and the scalar tail
+    std::vector<int> magnitudes(1001);
+    for (auto& v : magnitudes) v = static_cast<int>(gen() >> (8 * (gen() % 4)));
+    columns.push_back({"mixed magnitudes", magnitudes});
+
+    std::vector<int> full_range(777);
+    for (auto& v : full_range) v = static_cast<int>(gen());
+    columns.push_back({"full range", full_range});
+
+    for (const auto& column : columns) {
+        if (!check_column(column.first, column.second)) return 1;
+    }
+    return 0;
+}
+#endif // INT_CODEC_TEST
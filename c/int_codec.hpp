@@ -0,0 +1,35 @@
+#ifndef INT_CODEC_HPP
+#define INT_CODEC_HPP
+
+#include <cstdint>
+#include <vector>
+#include "bit_buffer.hpp"
+
+// Codecs for the integer columns of a block. The encoder tries each of them
+// on a column and records the one that gave the fewest bytes.
+enum class IntCodec : uint8_t {
+    BIT_PACKING,     // Values at the bit width of the largest, non-negative values only
+    TS2DIFF,         // PFOR blocks of the deltas
+    PFOR,            // PFOR blocks of the values themselves
+    VARINT,          // Stream VByte
+    RLE,             // Run count (32), PFOR blocks of the run values, gamma-coded run lengths
+    DELTA_OF_DELTA,  // PFOR blocks of the second differences
+    COUNT
+};
+
+const char* int_codec_name(IntCodec codec);
+
+// Whether codec can encode all of values
+bool int_codec_supports(IntCodec codec, const std::vector<int>& values);
+
+// Write values as their count (32) and the codec's encoding, padded to a
+// byte. Throws std::invalid_argument if the codec cannot encode them.
+void int_codec_encode(IntCodec codec, const std::vector<int>& values, BitOutBuffer& stream);
+// Read values written by int_codec_encode with the same codec
+std::vector<int> int_codec_decode(IntCodec codec, BitInBuffer& stream);
+
+// Encode values with every codec that supports them, write the shortest
+// encoding to stream and return its codec
+IntCodec int_codec_encode_best(const std::vector<int>& values, BitOutBuffer& stream);
+
+#endif // INT_CODEC_HPP
@@ -0,0 +1,134 @@
+#include "line_reader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+size_t splitLines(const char* data, size_t from, size_t to, size_t max_lines,
+                  std::vector<size_t>& ends) {
+    size_t found = 0;
+    size_t i = from;
+    if (max_lines == 0) return 0;
+#if defined(__SSE2__)
+    // Compare 64 bytes at a time and walk the set bits of the newline mask
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 64 <= to; i += 64) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(data + i);
+        uint64_t mask =
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p), newline)))) |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 1), newline)))) << 16 |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 2), newline)))) << 32 |
+            static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(p + 3), newline)))) << 48;
+        while (mask != 0) {
+            ends.push_back(i + __builtin_ctzll(mask) + 1);
+            if (++found == max_lines) return found;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i < to) {
+        const char* hit = static_cast<const char*>(std::memchr(data + i, '\n', to - i));
+        if (hit == nullptr) break;
+        i = hit - data + 1;
+        ends.push_back(i);
+        if (++found == max_lines) return found;
+    }
+    return found;
+}
+
+LineReader::~LineReader() {
+    if (map_ != nullptr) {
+        munmap(const_cast<char*>(map_), map_size_);
+    }
+    if (owns_fd_ && fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool LineReader::open(const std::string& path) {
+    if (path == "-") {
+        fd_ = STDIN_FILENO;
+        owns_fd_ = false;
+    } else {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) return false;
+        owns_fd_ = true;
+    }
+
+    // Map regular files, anything else (or a failed mapping) is read in chunks
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            map_ = static_cast<const char*>(map);
+            map_size_ = st.st_size;
+        }
+    }
+    return true;
+}
+
+size_t LineReader::readBlock(LineArena& block, size_t max_lines) {
+    block.clear();
+    return map_ != nullptr ? readMapped(block, max_lines) : readStream(block, max_lines);
+}
+
+size_t LineReader::readMapped(LineArena& block, size_t max_lines) {
+    block.external_ = map_ + map_pos_;
+    size_t remaining = map_size_ - map_pos_;
+    size_t lines = splitLines(block.external_, 0, remaining, max_lines, block.offsets_);
+    if (lines < max_lines && block.offsets_.back() < remaining) {
+        // Last line without '\n', counted as if it had one
+        block.offsets_.push_back(remaining + 1);
+        lines++;
+    }
+    map_pos_ = std::min(map_size_, map_pos_ + block.offsets_.back());
+    return lines;
+}
+
+size_t LineReader::readStream(LineArena& block, size_t max_lines) {
+    std::string& bytes = block.bytes_;
+    bytes.swap(pending_);
+    pending_.clear();
+
+    size_t lines = 0;
+    size_t scanned = 0;
+    while (true) {
+        lines += splitLines(bytes.data(), scanned, bytes.size(), max_lines - lines, block.offsets_);
+        scanned = bytes.size();
+        if (lines == max_lines || eof_) break;
+
+        size_t old_size = bytes.size();
+        bytes.resize(old_size + READ_CHUNK);
+        ssize_t n;
+        do {
+            n = read(fd_, &bytes[old_size], READ_CHUNK);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            throw std::runtime_error(std::string("Failed to read input: ") + std::strerror(errno));
+        }
+        bytes.resize(old_size + n);
+        if (n == 0) eof_ = true;
+    }
+
+    size_t end = block.offsets_.back();
+    if (lines == max_lines) {
+        // Keep what follows the last line for the next block
+        pending_.assign(bytes, end, std::string::npos);
+        bytes.resize(end);
+    } else if (end < bytes.size()) {
+        // Last line without '\n'
+        bytes.push_back('\n');
+        block.offsets_.push_back(bytes.size());
+        lines++;
+    }
+    return lines;
+}
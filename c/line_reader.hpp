@@ -0,0 +1,49 @@
+#ifndef LINE_READER_HPP
+#define LINE_READER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "line_window.hpp"
+
+// Splits the compressor input into blocks of lines with the same result as
+// std::getline: lines end at '\n', which is not part of the line, and a last
+// line without '\n' is still a line. Regular files are memory mapped and
+// blocks are views into the mapping; pipes and "-" (stdin) are read in large
+// chunks into the block's own buffer.
+class LineReader {
+public:
+    LineReader() = default;
+    ~LineReader();
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    bool open(const std::string& path);
+
+    // Replace block with the next max_lines lines, or fewer at the end of the
+    // input. Returns the number of lines read. Blocks of a mapped file stay
+    // valid until the reader is destroyed.
+    size_t readBlock(LineArena& block, size_t max_lines);
+
+private:
+    static constexpr size_t READ_CHUNK = 4 << 20;  // Bytes per read() for pipes
+
+    int fd_ = -1;
+    bool owns_fd_ = false;
+    const char* map_ = nullptr;  // Mapped file, or nullptr when reading
+    size_t map_size_ = 0;
+    size_t map_pos_ = 0;         // Start of the next unread line in map_
+    std::string pending_;        // Bytes read past the last block
+    bool eof_ = false;
+
+    size_t readMapped(LineArena& block, size_t max_lines);
+    size_t readStream(LineArena& block, size_t max_lines);
+};
+
+// Append the end offset (one past the '\n') of each line found in
+// data[from, to) to ends, stopping after max_lines. Returns the lines found.
+size_t splitLines(const char* data, size_t from, size_t to, size_t max_lines,
+                  std::vector<size_t>& ends);
+
+#endif // LINE_READER_HPP
@@ -0,0 +1,124 @@
+#ifndef LINE_WINDOW_HPP
+#define LINE_WINDOW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Lines of a block stored back to back in one buffer, each followed by '\n',
+// so the buffer is also the block's text. Growing the buffer moves it, and
+// views of earlier lines must then be rebased (see LineWindow::rebase).
+// The lines can also live in memory owned elsewhere, such as a mapped input
+// file (see LineReader); the last line of such memory may lack its '\n'.
+class LineArena {
+    friend class LineReader;
+
+public:
+    LineArena() : offsets_(1, 0) {}
+
+    void reserve(size_t bytes, size_t lines) {
+        bytes_.reserve(bytes);
+        offsets_.reserve(lines + 1);
+    }
+
+    std::string_view add(std::string_view line) {
+        bytes_.append(line.data(), line.size());
+        bytes_.push_back('\n');
+        offsets_.push_back(bytes_.size());
+        return (*this)[offsets_.size() - 2];
+    }
+
+    // Append a line of size bytes for the caller to fill in
+    char* append(size_t size) {
+        size_t begin = bytes_.size();
+        bytes_.resize(begin + size + 1);
+        bytes_[begin + size] = '\n';
+        offsets_.push_back(bytes_.size());
+        return &bytes_[begin];
+    }
+
+    void clear() {
+        bytes_.clear();
+        offsets_.assign(1, 0);
+        external_ = nullptr;
+    }
+
+    size_t size() const { return offsets_.size() - 1; }
+    size_t text_size() const { return offsets_.back() - offsets_.front(); }  // Lines plus '\n's
+    std::string_view operator[](size_t i) const {
+        return std::string_view(data() + offsets_[i], offsets_[i + 1] - offsets_[i] - 1);
+    }
+
+    const char* data() const { return external_ ? external_ : bytes_.data(); }
+    const std::string& bytes() const { return bytes_; }  // Owned lines only
+
+private:
+    std::string bytes_;
+    std::vector<size_t> offsets_;     // Start of each line, plus the end of the last
+    const char* external_ = nullptr;  // Lines owned elsewhere, if set
+};
+
+// The most recent lines as a fixed-capacity ring of views. Index 0 is the
+// oldest line, matching the reference indexes stored in the archive. The
+// lines are owned elsewhere, usually by the current block's LineArena.
+class LineWindow {
+public:
+    explicit LineWindow(size_t capacity) : slots_(capacity ? capacity : 1) {}
+
+    // Add the newest line, dropping the oldest one when the window is full
+    void push(std::string_view line) {
+        slots_[(head_ + count_) % slots_.size()] = line;
+        if (count_ < slots_.size()) {
+            count_++;
+        } else {
+            head_ = (head_ + 1) % slots_.size();
+        }
+    }
+
+    std::string_view operator[](size_t i) const { return slots_[(head_ + i) % slots_.size()]; }
+    size_t size() const { return count_; }
+    void clear() {
+        head_ = 0;
+        count_ = 0;
+    }
+
+    // Repoint views into [old_begin, old_begin + old_size) at new_begin,
+    // after the buffer holding them was moved
+    void rebase(const char* old_begin, size_t old_size, const char* new_begin) {
+        uintptr_t begin = reinterpret_cast<uintptr_t>(old_begin);
+        for (size_t i = 0; i < count_; i++) {
+            std::string_view& slot = slots_[(head_ + i) % slots_.size()];
+            uintptr_t p = reinterpret_cast<uintptr_t>(slot.data());
+            if (p >= begin && p - begin < old_size) {
+                slot = std::string_view(new_begin + (p - begin), slot.size());
+            }
+        }
+    }
+
+    // Copy the lines into storage and point the window at the copies, so
+    // the window outlives the buffer it pointed into. Only the window is
+    // copied, not the block.
+    void detach(std::string& storage) {
+        size_t total = 0;
+        for (size_t i = 0; i < count_; i++) total += (*this)[i].size();
+        std::string copy;
+        copy.reserve(total);
+        for (size_t i = 0; i < count_; i++) copy.append((*this)[i].data(), (*this)[i].size());
+        storage.swap(copy);
+        size_t offset = 0;
+        for (size_t i = 0; i < count_; i++) {
+            std::string_view& slot = slots_[(head_ + i) % slots_.size()];
+            slot = std::string_view(storage.data() + offset, slot.size());
+            offset += slot.size();
+        }
+    }
+
+private:
+    std::vector<std::string_view> slots_;
+    size_t head_ = 0;   // Slot of the oldest line
+    size_t count_ = 0;
+};
+
+#endif // LINE_WINDOW_HPP
@@ -0,0 +1,105 @@
+#include "output_sink.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Write all of data, retrying short writes and interrupts
+static bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+OutputSink::~OutputSink() {
+    close();
+}
+
+bool OutputSink::open(const std::string& path) {
+    if (path == "-") {
+        return open(STDOUT_FILENO);
+    }
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) return false;
+    owns_fd_ = true;
+    struct stat st;
+    positional_ = fstat(fd_, &st) == 0 && S_ISREG(st.st_mode);
+    buffer_.resize(BUFFER_SIZE);
+    return true;
+}
+
+bool OutputSink::open(int fd) {
+    fd_ = fd;
+    owns_fd_ = false;
+    positional_ = false;
+    buffer_.resize(BUFFER_SIZE);
+    return fd_ >= 0;
+}
+
+bool OutputSink::write(const char* data, size_t size) {
+    if (fd_ < 0 || failed_) return false;
+    if (used_ + size <= buffer_.size()) {
+        std::memcpy(buffer_.data() + used_, data, size);
+        used_ += size;
+        return true;
+    }
+    // Large writes, such as whole blocks, bypass the buffer
+    if (!flush()) return false;
+    if (size >= buffer_.size()) {
+        failed_ = !writeAll(fd_, data, size);
+        return !failed_;
+    }
+    std::memcpy(buffer_.data(), data, size);
+    used_ = size;
+    return true;
+}
+
+bool OutputSink::flush() {
+    if (used_ > 0) {
+        failed_ = failed_ || !writeAll(fd_, buffer_.data(), used_);
+        used_ = 0;
+    }
+    return !failed_;
+}
+
+bool OutputSink::preallocate(uint64_t size) {
+    if (!positional_) return false;
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) return false;
+    // Reserve the blocks up front where the file system supports it
+    if (size > 0) {
+        posix_fallocate(fd_, 0, static_cast<off_t>(size));
+    }
+    return true;
+}
+
+bool OutputSink::writeAt(const char* data, size_t size, uint64_t offset) {
+    if (!positional_) return false;
+    while (size > 0) {
+        ssize_t n = pwrite(fd_, data, size, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool OutputSink::close() {
+    if (fd_ < 0) return !failed_;
+    bool ok = flush();
+    if (owns_fd_ && ::close(fd_) != 0) ok = false;
+    fd_ = -1;
+    owns_fd_ = false;
+    return ok;
+}
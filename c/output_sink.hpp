@@ -0,0 +1,46 @@
+#ifndef OUTPUT_SINK_HPP
+#define OUTPUT_SINK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Destination of decompressed text: a file, "-" (stdout) or a caller's file
+// descriptor. Sequential writes go through a large buffer. Regular files
+// can also be preallocated and written at given offsets from several
+// threads at once, which lets independent blocks land in place as soon as
+// they are decoded.
+class OutputSink {
+public:
+    OutputSink() = default;
+    ~OutputSink();
+
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    bool open(const std::string& path);
+    bool open(int fd);  // The descriptor stays open after close()
+
+    bool write(const char* data, size_t size);
+    bool close();  // Flush and close, false if any write failed
+
+    // Positional writes, only for regular files opened by path
+    bool positional() const { return positional_; }
+    bool preallocate(uint64_t size);
+    bool writeAt(const char* data, size_t size, uint64_t offset);  // Thread safe
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    int fd_ = -1;
+    bool owns_fd_ = false;
+    bool positional_ = false;
+    bool failed_ = false;
+    std::vector<char> buffer_;
+    size_t used_ = 0;
+
+    bool flush();
+};
+
+#endif // OUTPUT_SINK_HPP
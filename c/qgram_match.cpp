@@ -3,14 +3,16 @@
 #include <algorithm>
 #include <iostream>
 
-OperationItem::OperationItem(int pos, int len1, int len2, const std::string& sub)
+OperationItem::OperationItem(int pos, int len1, int len2, std::string_view sub)
     : position(pos), length1(len1), length2(len2), substr(sub) {}
 
 // Generate Q-grams with padding
-std::vector<std::string> getQgram(const std::string& str, int k) {
+std::vector<std::string> getQgram(std::string_view str, int k) {
     std::vector<std::string> qgramList;
     // Add padding characters to handle string boundaries
-    std::string paddedStr = std::string(k-1, '$') + str + std::string(k-1, '#');
+    std::string paddedStr(k-1, '$');
+    paddedStr.append(str.data(), str.size());
+    paddedStr.append(k-1, '#');
     
     // Generate q-grams using sliding window
     for (size_t i = 0; i <= paddedStr.length() - k; ++i) {
@@ -20,7 +22,7 @@ std::vector<std::string> getQgram(const std::string& str, int k) {
 }
 
 std::pair<std::vector<OperationItem>, double> getQgramMatchOplist(
-    const std::string& str1, const std::string& str2, int k) {
+    std::string_view str1, std::string_view str2, int k) {
     
     int lenStr1 = str1.length();
     int lenStr2 = str2.length();
@@ -151,7 +153,7 @@ std::pair<std::vector<OperationItem>, double> getQgramMatchOplist(
             int position = preItem[1] + 1;
             int length1 = item[0] - preItem[1] - 1;
             int length2 = item[2] - preItem[3] - 1;
-            std::string substr = str2.substr(preItem[3] + 1, item[2] - preItem[3] - 1);
+            std::string_view substr = str2.substr(preItem[3] + 1, item[2] - preItem[3] - 1);
             operationList.emplace_back(position, length1, length2, substr);
         }
         preItem = item;
@@ -178,7 +180,7 @@ std::pair<std::vector<OperationItem>, double> getQgramMatchOplist(
 
 std::string recoverQgramString(
     const std::vector<OperationItem>& operationList,
-    const std::string& str1) {
+    std::string_view str1) {
     std::string result;
     size_t oldPos = 0;
     
@@ -2,6 +2,7 @@
 #define QGRAM_MATCH_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <utility>
 
@@ -12,23 +13,23 @@ struct OperationItem {
     int length2;       // Length of the replacement substring
     std::string substr;// Replacement substring
     
-    OperationItem(int pos, int len1, int len2, const std::string& sub);
+    OperationItem(int pos, int len1, int len2, std::string_view sub);
 };
 
 // Generate q-grams from input string with specified length k
-std::vector<std::string> getQgram(const std::string& str, int k = 3);
+std::vector<std::string> getQgram(std::string_view str, int k = 3);
 
 // Get Q-gram match operations and distance between two strings
 std::pair<std::vector<OperationItem>, double> getQgramMatchOplist(
-    const std::string& str1, 
-    const std::string& str2, 
+    std::string_view str1, 
+    std::string_view str2, 
     int k = 3
 );
 
 // Recover string using Q-gram operation list
 std::string recoverQgramString(
     const std::vector<OperationItem>& operationList, 
-    const std::string& str1
+    std::string_view str1
 );
 
 #endif // QGRAM_MATCH_HPP
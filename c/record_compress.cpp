@@ -6,7 +6,11 @@
 #include "qgram_match.hpp"
 #include "record_compress.hpp"
 #include "ts_2diff.hpp"
+#include "int_codec.hpp"
 #include "variable_length_substitution.hpp"
+#include "bounded_queue.hpp"
+#include "line_window.hpp"
+#include "line_reader.hpp"
 #include <chrono>
 #include <deque>
 #include <fstream>
@@ -15,6 +19,10 @@
 #include <stdexcept>
 #include <algorithm>
 #include <iomanip>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <memory>
 
 // Define macro for encoding statistics output
 #ifndef ENCODING_STATS
@@ -23,216 +31,276 @@
 
 #define PRINT_STATS(x) if (ENCODING_STATS) { std::cout << x << std::endl; }
 
-void printRecord(const Record& record, int idx) {
-    std::cout << "Record[" << idx << "]: method=" << record.method
-            //   << ", another_line=" << record.another_line
-              << ", begin=" << record.begin
-              << ", operation_size=" << record.operation_size;
-    std::cout << "  position_list: ";
-    for (auto v : record.position_list) std::cout << v << " ";
-    std::cout << "  d_length: ";
-    for (auto v : record.d_length) std::cout << v << " ";
-    std::cout << "  i_length: ";
-    for (auto v : record.i_length) std::cout << v << " ";
-    std::cout << "  sub_string: ";
-    for (auto& s : record.sub_string) std::cout << '"' << s << '"' << " ";
-    std::cout << std::endl;
+void BlockColumns::addLiteral(std::string_view line) {
+    method.push_back(1);
+    strings1 += line;
+    strings1 += '\n';
 }
 
-void byteArrayEncoding(const std::vector<Record>& records, const std::string& output_path, CompressorType compressor) {
-    BitOutBuffer stream;
+void BlockColumns::addMatch(int begin, const std::vector<OperationItem>& ops) {
+    method.push_back(0);
+    begins.push_back(begin);
+    operation_sizes.push_back(static_cast<int>(ops.size()));
+    for (const auto& op : ops) {
+        lengths.push_back(op.length1);
+    }
+    for (const auto& op : ops) {
+        lengths.push_back(op.length2);
+    }
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (i == 0) {
+            position_begins.push_back(ops[i].position);
+        } else {
+            position_deltas.push_back(ops[i].position - ops[i - 1].position);
+        }
+        strings0 += ops[i].substr;
+    }
+}
+
+void BlockColumns::append(const BlockColumns& other) {
+    method.insert(method.end(), other.method.begin(), other.method.end());
+    begins.insert(begins.end(), other.begins.begin(), other.begins.end());
+    operation_sizes.insert(operation_sizes.end(), other.operation_sizes.begin(), other.operation_sizes.end());
+    lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+    position_begins.insert(position_begins.end(), other.position_begins.begin(), other.position_begins.end());
+    position_deltas.insert(position_deltas.end(), other.position_deltas.begin(), other.position_deltas.end());
+    strings0 += other.strings0;
+    strings1 += other.strings1;
+}
 
-    // Separate records with method 0 and 1
-    std::vector<Record> records0, records1;
-    for (const auto& record : records) {
-        if (record.method == 0) records0.push_back(record);
-        else records1.push_back(record);
+// Compress a section in place, keeping it as it is when compressor does not
+// make it smaller. Returns the compressor the section ends up stored with.
+static CompressorType compressSection(std::vector<uint8_t>& section, CompressorType compressor, int level,
+                                      const ZstdDictionary* dictionary = nullptr) {
+    if (section.empty() || compressor == CompressorType::NONE) return CompressorType::NONE;
+    std::vector<uint8_t> compressed;
+    if (!BitCompressor::compress_buffer(section.data(), section.size(), compressor, level, compressed, dictionary) ||
+        compressed.size() >= section.size()) {
+        return CompressorType::NONE;
     }
+    section.swap(compressed);
+    return compressor;
+}
 
+void byteArrayEncoding(const BlockColumns& columns, BitOutBuffer& stream, uint8_t format_flags,
+                       CompressorType compressor, const ZstdDictionary* dictionary) {
     PRINT_STATS("\n=== Block Encoding Statistics ===");
-    PRINT_STATS("Records0 (method 0) count: " << records0.size());
-    PRINT_STATS("Records1 (method 1) count: " << records1.size());
-    PRINT_STATS("Total records: " << records.size());
-
-    // Encode record counts
-    stream.encode(records0.size(), 32);
-    stream.encode(records1.size(), 32);
-    PRINT_STATS("Record counts encoding length: " << 8 << " bytes");
-
-    // Encode method using RLE
-    std::vector<int> method_list;
-    for (const auto& record : records) {
-        method_list.push_back(record.method);
-    }
-    auto method_encoded = rleEncode(method_list);
-    std::vector<unsigned char> rle_bytes = method_encoded.bytes;
-    size_t method_interval_count = method_encoded.interval_count;
-    std::string rle_string;
-    for (unsigned char byte : rle_bytes) {
-        rle_string += std::bitset<8>(byte).to_string();
-    }
-    size_t method_length = (rle_string.length() + 7) / 8;
-    while (rle_string.length() < method_length * 8) {
-        rle_string += '0';
-    }
-    stream.encode(static_cast<int>(method_length), 16);
-    for (size_t i = 0; i < method_length; i++) {
-        int bf = std::stoi(rle_string.substr(i * 8, 8), nullptr, 2);
-        stream.encode(bf, 8);
-    }
-    stream.encode(method_interval_count, 32);
-    PRINT_STATS("Method encoding length: " << (2 + method_length + 4) << " bytes");
-
-    // // Encode another_line using RLE
-    // std::vector<int> another_line_list;
-    // for (const auto& record : records) {
-    //     another_line_list.push_back(record.another_line);
-    // }
-    // auto line_encoded = rleEncode(another_line_list);
-    // rle_bytes = line_encoded.bytes;
-    // size_t line_interval_count = line_encoded.interval_count;
-    // rle_string.clear();
-    // for (unsigned char byte : rle_bytes) {
-    //     rle_string += std::bitset<8>(byte).to_string();
-    // }
-    // size_t line_length = (rle_string.length() + 7) / 8;
-    // while (rle_string.length() < line_length * 8) {
-    //     rle_string += '0';
-    // }
-    // stream.encode(static_cast<int>(line_length), 16);
-    // for (size_t i = 0; i < line_length; i++) {
-    //     int bf = std::stoi(rle_string.substr(i * 8, 8), nullptr, 2);
-    //     stream.encode(bf, 8);
-    // }
-    // stream.encode(line_interval_count, 32);
-    // PRINT_STATS("Line encoding length: " << (2 + line_length + 4) << " bytes");
-
-    // Encode begin using bit packing
-    std::vector<int> begins;
-    for (const auto& record : records0) {
-        begins.push_back(record.begin);
-    }
-
-    if (begins.empty()) {
-        stream.encode(0, 16);
-        PRINT_STATS("Begin encoding length: 2 bytes (empty)");
-    } else {
-        std::vector<unsigned char> packed_bytes = bit_packing_encode(begins);
-        std::string bit_packing_string;
-        for (unsigned char byte : packed_bytes) {
-            bit_packing_string += std::bitset<8>(byte).to_string();
-        }
-        size_t begin_length = (bit_packing_string.length() + 7) / 8;
-        while (bit_packing_string.length() < begin_length * 8) {
-            bit_packing_string += '0';
-        }
-        stream.encode(static_cast<int>(begin_length), 16);
-        for (size_t i = 0; i < begin_length; i++) {
-            int bf = std::stoi(bit_packing_string.substr(i * 8, 8), nullptr, 2);
-            stream.encode(bf, 8);
-        }
-        PRINT_STATS("Begin encoding length: " << (2 + begin_length) << " bytes");
+    PRINT_STATS("Records0 (method 0) count: " << columns.records0());
+    PRINT_STATS("Records1 (method 1) count: " << columns.records1());
+    PRINT_STATS("Total records: " << columns.size());
+
+    // Each column is encoded into its own section, empty columns give empty sections
+    std::vector<uint8_t> sections[BlockColumn::COUNT];
+    size_t raw_sizes[BlockColumn::COUNT] = {};
+    CompressorType section_compressors[BlockColumn::COUNT] = {};
+    const bool compressed_sections = format_flags & FormatFlags::COMPRESSED_SECTIONS;
+    size_t string_size = columns.strings0.size() + columns.strings1.size();
+
+    // The text takes longest to compress, so it is compressed while the
+    // integer columns are encoded
+    std::future<void> text_future;
+    if (compressed_sections) {
+        text_future = std::async(std::launch::async, [&]() {
+            std::vector<uint8_t>& text = sections[BlockColumn::STRING];
+            text.reserve(string_size);
+            text.insert(text.end(), columns.strings0.begin(), columns.strings0.end());
+            text.insert(text.end(), columns.strings1.begin(), columns.strings1.end());
+            raw_sizes[BlockColumn::STRING] = string_size;
+            section_compressors[BlockColumn::STRING] = compressSection(text, compressor, BitCompressor::DEFAULT_LEVEL, dictionary);
+        });
     }
 
-    // Encode operation_size using bit packing
-    std::vector<int> operation_sizes;
-    for (const auto& record : records0) {
-        operation_sizes.push_back(record.operation_size);
+    // Encode each integer column with the codec that gives the fewest bytes
+    const std::vector<int>* integer_columns[BlockColumn::INTEGER_COUNT] = {
+        &columns.method, &columns.begins, &columns.operation_sizes,
+        &columns.lengths, &columns.position_begins, &columns.position_deltas};
+    IntCodec codecs[BlockColumn::INTEGER_COUNT] = {};
+    for (int c = 0; c < BlockColumn::INTEGER_COUNT; c++) {
+        if (integer_columns[c]->empty()) continue;
+        BitOutBuffer column;
+        codecs[c] = int_codec_encode_best(*integer_columns[c], column);
+        sections[c] = column.take_bytes();
+        raw_sizes[c] = sections[c].size();
+        if (compressed_sections) {
+            // Integer columns are mostly dense already, so fast LZ4 is tried
+            // first. The archive's compressor is kept only where it is clearly
+            // smaller, such as on long repeating patterns.
+            std::vector<uint8_t> heavy = sections[c];
+            section_compressors[c] = compressSection(sections[c], CompressorType::LZ4, 0);
+            CompressorType heavy_compressor = compressSection(heavy, compressor, BitCompressor::DEFAULT_LEVEL, dictionary);
+            if (heavy_compressor != CompressorType::NONE && heavy.size() < sections[c].size() * 7 / 8) {
+                sections[c].swap(heavy);
+                section_compressors[c] = heavy_compressor;
+            }
+        }
+        PRINT_STATS("Column " << c << " encoding length: " << sections[c].size()
+                    << " bytes (" << int_codec_name(codecs[c]) << ")");
+    }
+    if (compressed_sections) {
+        text_future.get();
     }
 
-    if (operation_sizes.empty()) {
-        stream.encode(0, 16);
-        PRINT_STATS("Operation size encoding length: 2 bytes (empty)");
-    } else {
-        std::vector<unsigned char> packed_bytes = bit_packing_encode(operation_sizes);
-        std::string bit_packing_string;
-        for (unsigned char byte : packed_bytes) {
-            bit_packing_string += std::bitset<8>(byte).to_string();
+    // Write record counts, the section directory, the codecs and the sections.
+    // Uncompressed, the string section is written straight from the two
+    // string columns.
+    stream.encode_32(columns.records0());
+    stream.encode_32(columns.records1());
+    for (int c = 0; c < BlockColumn::COUNT; c++) {
+        bool direct_strings = c == BlockColumn::STRING && !compressed_sections;
+        uint64_t section_size = direct_strings ? string_size : sections[c].size();
+        stream.encode_32(static_cast<uint32_t>(section_size >> 32));
+        stream.encode_32(static_cast<uint32_t>(section_size));
+    }
+    for (IntCodec codec : codecs) {
+        stream.encode_8(static_cast<uint8_t>(codec));
+    }
+    if (compressed_sections) {
+        for (int c = 0; c < BlockColumn::COUNT; c++) {
+            stream.encode_8(static_cast<uint8_t>(section_compressors[c]));
+            uint64_t raw_size = raw_sizes[c];
+            stream.encode_32(static_cast<uint32_t>(raw_size >> 32));
+            stream.encode_32(static_cast<uint32_t>(raw_size));
         }
-        size_t operation_length = (bit_packing_string.length() + 7) / 8;
-        while (bit_packing_string.length() < operation_length * 8) {
-            bit_packing_string += '0';
+    }
+    for (const auto& section : sections) {
+        stream.append_bytes(section.data(), section.size());
+    }
+    if (!compressed_sections) {
+        stream.append_bytes(columns.strings0.data(), columns.strings0.size());
+        stream.append_bytes(columns.strings1.data(), columns.strings1.size());
+    }
+    PRINT_STATS("String encoding size: " << sections[BlockColumn::STRING].size() << " of "
+                << string_size << " bytes");
+    PRINT_STATS("=== End of Block Encoding ===\n");
+}
+
+// Add the text of a block to the samples a zstd dictionary is trained
+// from: the inserted substrings of each method 0 line, and each method 1
+// line. Returns the number of bytes added.
+static size_t collectDictionarySamples(const BlockColumns& columns, std::vector<std::string_view>& samples) {
+    size_t added = 0;
+    std::string_view strings0(columns.strings0);
+    size_t length_idx = 0;
+    size_t offset = 0;
+    for (int operation_size : columns.operation_sizes) {
+        length_idx += operation_size;  // Skip d lengths
+        size_t size = 0;
+        for (int j = 0; j < operation_size; j++) {
+            size += columns.lengths[length_idx++];
         }
-        stream.encode(static_cast<int>(operation_length), 16);
-        for (size_t i = 0; i < operation_length; i++) {
-            int bf = std::stoi(bit_packing_string.substr(i * 8, 8), nullptr, 2);
-            stream.encode(bf, 8);
+        if (size > 0) {
+            samples.push_back(strings0.substr(offset, size));
+            offset += size;
+            added += size;
         }
-        PRINT_STATS("Operation size encoding length: " << (2 + operation_length) << " bytes");
     }
-
-    // Encode lengths
-    std::vector<int> length_list;
-    for (const auto& record : records0) {
-        length_list.insert(length_list.end(), record.d_length.begin(), record.d_length.end());
-        length_list.insert(length_list.end(), record.i_length.begin(), record.i_length.end());
+    std::string_view strings1(columns.strings1);
+    for (size_t begin = 0; begin < strings1.size();) {
+        size_t end = strings1.find('\n', begin);
+        if (end == std::string_view::npos) end = strings1.size();
+        if (end > begin) {
+            samples.push_back(strings1.substr(begin, end - begin));
+            added += end - begin;
+        }
+        begin = end + 1;
     }
+    return added;
+}
 
-    size_t length_encoding_size = 0;
-    if (!records0.empty()) {
-        length_encoding_size = ts2diff_encode(length_list, stream);
-        PRINT_STATS("Length encoding size: " << length_encoding_size << " bytes");
-    } else {
-        PRINT_STATS("Length encoding size: 0 bytes (empty)");
+// Per-chunk counters collected by matchLines
+struct MatchStats {
+    size_t matched_lines = 0;
+    double distance_time = 0;
+    double match_time = 0;
+};
+
+// Match lines [first, last) of a block against their reference windows and
+// append them to columns. context holds offset lines of carried-over window
+// followed by the block lines, so line i sees context[offset + i - window_size, offset + i).
+static void matchLines(const std::vector<std::string_view>& context, size_t offset,
+                       size_t first, size_t last, int window_size, double threshold,
+                       DistanceType distance, bool use_approx, int q_value, int sketch_bits,
+                       BlockColumns& columns, MatchStats& stats) {
+    // MinHash and SimHash hash every line once and keep the signatures of
+    // the window, starting from the lines just before this chunk
+    std::unique_ptr<MinHashWindow> signatures;
+    std::unique_ptr<SimHashWindow> fingerprints;
+    size_t chunk_begin = offset + first;
+    size_t warm_begin = chunk_begin > static_cast<size_t>(window_size) ? chunk_begin - window_size : 0;
+    if (distance == DistanceType::MINHASH) {
+        signatures = std::make_unique<MinHashWindow>(window_size, q_value, MinHash::DEFAULT_NUM_HASHES,
+                                                     sketch_bits);
+        for (size_t i = warm_begin; i < chunk_begin; i++) {
+            signatures->push(context[i]);
+        }
+    } else if (distance == DistanceType::SIMHASH) {
+        fingerprints = std::make_unique<SimHashWindow>(window_size, q_value);
+        for (size_t i = warm_begin; i < chunk_begin; i++) {
+            fingerprints->push(context[i]);
+        }
     }
 
-    // Encode positions
-    size_t position_encoding_size = 0;
-    if (!records0.empty()) {
-        std::vector<int> p_begin_list;
-        std::vector<int> p_delta_list;
-
-        for (const auto& record : records0) {
-            int oldp = -1;
-            for (int p : record.position_list) {
-                if (oldp == -1) {
-                    p_begin_list.push_back(p);
-                } else {
-                    p_delta_list.push_back(p - oldp);
+    for (size_t id = first; id < last; id++) {
+        size_t pos = offset + id;
+        size_t window_begin = pos > static_cast<size_t>(window_size) ? pos - window_size : 0;
+        std::string_view line = context[pos];
+        int begin = -1;
+
+        auto distance_start = std::chrono::high_resolution_clock::now();
+
+        // Calculate distances
+        double min_distance = 1.0;  // Initialize to maximum distance
+        if (signatures) {
+            begin = signatures->nearest(line, min_distance);
+            signatures->push(line);
+        } else if (fingerprints) {
+            begin = fingerprints->nearest(line, min_distance);
+            fingerprints->push(line);
+        } else {
+            for (size_t i = 0; i < pos - window_begin; i++) {
+                double tmp_dist = Distance::calculateDistance(context[window_begin + i], line, distance, q_value);
+                if (tmp_dist < min_distance) {
+                    min_distance = tmp_dist;
+                    begin = static_cast<int>(i);
                 }
-                oldp = p;
             }
         }
 
-        // Use ts2diff to encode begin positions
-        if (!p_begin_list.empty()) {
-            size_t begin_pos_size = ts2diff_encode(p_begin_list, stream);
-            position_encoding_size += begin_pos_size;
-            PRINT_STATS("Begin positions encoding size: " << begin_pos_size << " bytes");
+        // Since all distances are now in [0,1], we can use threshold directly
+        if (min_distance >= threshold) {
+            begin = -1;
         }
 
-        // Use ts2diff to encode delta positions
-        if (!p_delta_list.empty()) {
-            size_t delta_pos_size = ts2diff_encode(p_delta_list, stream);
-            position_encoding_size += delta_pos_size;
-            PRINT_STATS("Delta positions encoding size: " << delta_pos_size << " bytes");
-        }
-    } else {
-        PRINT_STATS("Position encoding size: 0 bytes (empty)");
-    }
+        auto distance_end = std::chrono::high_resolution_clock::now();
+        stats.distance_time += std::chrono::duration<double>(distance_end - distance_start).count();
+
+        auto match_start = std::chrono::high_resolution_clock::now();
+        if (begin == -1) {
+            columns.addLiteral(line);
+        } else {
+            stats.matched_lines++;
+            std::string_view reference = context[window_begin + begin];
+            // Choose matching algorithm based on use_approx parameter
+            std::vector<OperationItem> op_list;
+            double new_distance;
+            if (use_approx) {
+                // Use approximate algorithm with specified Q
+                std::tie(op_list, new_distance) = getQgramMatchOplist(reference, line, q_value);
+            } else {
+                // Use exact algorithm
+                std::tie(op_list, new_distance) = getSubstitutionOplist(reference, line);
+            }
 
-    // Encode strings
-    std::string sub_string;
-    for (const auto& record : records0) {
-        for (const auto& s : record.sub_string) {
-            sub_string += s;
-        }
-    }
-    for (const auto& record : records1) {
-        for (const auto& s : record.sub_string) {
-            sub_string += s;
-            sub_string += '\n';  // Add newline for each string of record1
+            if (new_distance > line.length()) {
+                columns.addLiteral(line);
+            } else {
+                columns.addMatch(begin, op_list);
+            }
         }
-    }
 
-    // Encode strings
-    for (char byte : sub_string) {
-        stream.encode(static_cast<unsigned char>(byte), 8);
+        auto match_end = std::chrono::high_resolution_clock::now();
+        stats.match_time += std::chrono::duration<double>(match_end - match_start).count();
     }
-    PRINT_STATS("String encoding size: " << sub_string.length() << " bytes");
-    PRINT_STATS("=== End of Block Encoding ===\n");
-
-    stream.write(output_path, "ab");
 }
 
 double main_encoding_compress(const std::string& input_path, 
@@ -242,7 +310,12 @@ double main_encoding_compress(const std::string& input_path,
                                    CompressorType compressor,
                                    DistanceType distance,
                                    bool use_approx,
-                                   int q_value) {
+                                   int q_value,
+                                   int threads,
+                                   bool independent_blocks,
+                                   bool compressed_sections,
+                                   const std::string& zstd_dictionary,
+                                   int sketch_bits) {
     auto total_start_time = std::chrono::high_resolution_clock::now();
     
     // Add counters
@@ -254,162 +327,320 @@ double main_encoding_compress(const std::string& input_path,
     double distance_time = 0;
     double match_time = 0;
     double encoding_time = 0;
-    
-    std::deque<std::string> q;
-    // int new_line_flag = 0;
-    std::ifstream input(input_path, std::ios::binary);
-    
+    int block_cnt = 0;
+
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (!MinHashWindow::validBits(sketch_bits)) {
+        throw std::invalid_argument("Invalid sketch bits: " + std::to_string(sketch_bits));
+    }
+
+    LineReader input;
+    if (!input.open(input_path)) {
+        throw std::runtime_error("Failed to open input file: " + input_path);
+    }
+
     // Write encoding head
     BitOutBuffer stream;
-    stream.encode(window_size, 16);
+    stream.encode_16(ArchiveVersion::MARKER);
+    stream.encode_8(ArchiveVersion::CURRENT);
+    stream.encode_16(window_size);
     // stream.encode(block_size, 16);
     
+    // A zstd dictionary is trained from a corpus file up front, or from the
+    // first blocks when zstd_dictionary is "auto" (see the encoder stage)
+    constexpr size_t DICTIONARY_SAMPLE_BYTES = 100 * ZstdDictionary::MAX_CAPACITY;
+    std::unique_ptr<ZstdDictionary> dictionary;
+    bool train_dictionary = false;
+    if (!zstd_dictionary.empty()) {
+        if (!compressed_sections || compressor != CompressorType::ZSTD) {
+            throw std::invalid_argument("A zstd dictionary needs compressed sections and the zstd compressor");
+        }
+        if (zstd_dictionary == "auto") {
+            train_dictionary = true;
+        } else {
+            std::ifstream corpus(zstd_dictionary, std::ios::binary);
+            if (!corpus) {
+                throw std::runtime_error("Failed to open dictionary corpus: " + zstd_dictionary);
+            }
+            std::vector<std::string> lines;
+            size_t corpus_bytes = 0;
+            std::string line;
+            while (corpus_bytes < DICTIONARY_SAMPLE_BYTES && std::getline(corpus, line)) {
+                corpus_bytes += line.size();
+                lines.push_back(std::move(line));
+            }
+            std::vector<std::string_view> samples(lines.begin(), lines.end());
+            std::vector<uint8_t> bytes = ZstdDictionary::train(samples);
+            if (bytes.empty()) {
+                throw std::runtime_error("Failed to train a zstd dictionary from: " + zstd_dictionary);
+            }
+            dictionary.reset(new ZstdDictionary(std::move(bytes)));
+        }
+    }
+
     // Write parameter byte
     int compressor_val = static_cast<int>(compressor);
     int distance_val = static_cast<int>(distance);
     uint8_t param_byte = (compressor_val & 0xF) | ((distance_val & 0x7) << 4) | ((use_approx ? 1 : 0) << 7);
-    stream.encode(param_byte, 8);
-    stream.write(output_path, "wb");
-
-    bool loop_end = false;
-    int block_cnt = 0;
-
-    while (!loop_end) {
-        // Clear MinHash cache at the start of each block
-        std::vector<Record> records;
+    stream.encode_8(param_byte);
+
+    // Write format flags, then the dictionary. The header is finished once
+    // the dictionary is known.
+    uint8_t format_flags = (independent_blocks ? FormatFlags::INDEPENDENT_BLOCKS : 0) |
+                           (compressed_sections ? FormatFlags::COMPRESSED_SECTIONS : 0);
+    auto header_bytes = [&]() {
+        if (dictionary) {
+            if (!dictionary->valid()) {
+                throw std::runtime_error("Failed to load the zstd dictionary");
+            }
+            format_flags |= FormatFlags::ZSTD_DICTIONARY;
+        }
+        stream.encode_8(format_flags);
+        if (dictionary) {
+            const std::vector<uint8_t>& bytes = dictionary->bytes();
+            std::vector<uint8_t> compressed;
+            if (!BitCompressor::compress_buffer(bytes.data(), bytes.size(), CompressorType::ZSTD,
+                                                BitCompressor::DEFAULT_LEVEL, compressed)) {
+                throw std::runtime_error("Failed to compress the zstd dictionary");
+            }
+            stream.encode_32(bytes.size());
+            stream.encode_32(compressed.size());
+            stream.append_bytes(compressed.data(), compressed.size());
+        }
+        return stream.take_bytes();
+    };
+
+    // Encoded blocks go straight through the secondary compressor into the
+    // final file, there is no intermediate uncompressed archive. Its frames
+    // are compressed on the matching threads. Compressed sections are
+    // written as they are.
+    StreamCompressor sink;
+    CompressorType archive_compressor = compressed_sections ? CompressorType::NONE : compressor;
+    if (!sink.open(output_path, archive_compressor, threads) ||
+        (!train_dictionary && !sink.write(header_bytes()))) {
+        throw std::runtime_error("Failed to write output file: " + output_path);
+    }
 
-        MinHash::getInstance().clearCache();
-        
-        // std::vector<int> line_flag;
-        std::vector<std::string> line_list;
-        int index = 0;
+    // The compressor runs as a pipeline of stages connected by bounded queues:
+    // reader -> matcher -> encoder -> secondary compressor. Each queue holds
+    // at most PIPELINE_DEPTH blocks, so block N+1 is read and matched while
+    // block N is being encoded and compressed.
+    constexpr size_t PIPELINE_DEPTH = 2;
+    BoundedQueue<LineArena> line_queue(PIPELINE_DEPTH);
+    BoundedQueue<BlockColumns> column_queue(PIPELINE_DEPTH);
+    BoundedQueue<std::vector<uint8_t>> byte_queue(PIPELINE_DEPTH);
+
+    // First error raised by any stage; stops the whole pipeline
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto fail = [&](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = e;
+        }
+        line_queue.close();
+        column_queue.close();
+        byte_queue.close();
+    };
 
+    // Stage 1: read blocks of lines
+    std::thread reader([&]() {
+        try {
+            bool loop_end = false;
+            while (!loop_end) {
+                // std::vector<int> line_flag;
+                LineArena line_list;
+
+                auto read_start = std::chrono::high_resolution_clock::now();
+                size_t max_lines = block_size > 0 ? static_cast<size_t>(block_size) : 1;
+                if (input.readBlock(line_list, max_lines) < max_lines) {
+                    loop_end = true;
+                }
+                auto read_end = std::chrono::high_resolution_clock::now();
+                read_time += std::chrono::duration<double>(read_end - read_start).count();
 
-        auto read_start = std::chrono::high_resolution_clock::now();
-        // // Read data block
-        // auto read_start = std::chrono::high_resolution_clock::now();
-        while (index < block_size) {
-            std::string line;
-            if (!std::getline(input, line)) {
-                loop_end = true;
-                break;
+                if (!line_queue.push(std::move(line_list))) break;
             }
-            line_list.push_back(line);
-            index++;
+        } catch (...) {
+            fail(std::current_exception());
         }
-        auto read_end = std::chrono::high_resolution_clock::now();
-        read_time += std::chrono::duration<double>(read_end - read_start).count();
-
-        // Output the first 20 records
-        // std::cout << "\nFirst 20 lines in line_list:" << std::endl;
-        // for (int i = 0; i < std::min(20, (int)line_list.size()); i++) {
-        //     std::cout << "Line " << i << ": " << line_list[i] << std::endl;
-        // }
-        // std::cout << std::endl;
-
-        // Process each line
-        int id = 0;
-        for (const auto& line : line_list) {
-            total_lines++;
-            int begin = -1;
-
-            auto distance_start = std::chrono::high_resolution_clock::now();
-
-            // Calculate distances
-            double min_distance = 1.0;  // Initialize to maximum distance
-            for (size_t i = 0; i < q.size(); i++) {
-                double tmp_dist = Distance::calculateDistance(q[i], line, distance, q_value);
-                if (tmp_dist < min_distance) {
-                    min_distance = tmp_dist;
-                    begin = static_cast<int>(i);
-                }
-            }
-            
-            // Since all distances are now in [0,1], we can use threshold directly
-            if (min_distance >= threshold) {
-                begin = -1;
-            }
-
-            auto distance_end = std::chrono::high_resolution_clock::now();
-            distance_time += std::chrono::duration<double>(distance_end - distance_start).count();
+        line_queue.close();
+    });
 
-            auto match_start = std::chrono::high_resolution_clock::now();
-            Record record;
-            if (begin == -1) {
-                record.method = 1;
-                record.sub_string.push_back(line);
-            } else {
-                matched_lines++;
-                // Choose matching algorithm based on use_approx parameter
-                std::vector<OperationItem> op_list;
-                double new_distance;
-                if (use_approx) {
-                    // Use approximate algorithm with specified Q
-                    std::tie(op_list, new_distance) = getQgramMatchOplist(q[begin], line, q_value);
-                } else {
-                    // Use exact algorithm
-                    std::tie(op_list, new_distance) = getSubstitutionOplist(q[begin], line);
+    // Stage 2: match every line of a block against its reference window
+    std::thread matcher([&]() {
+        try {
+            // The window points into the current block, or into carry once the
+            // block it points into is released
+            LineWindow q(window_size);
+            std::string carry;
+            LineArena line_list;
+            while (line_queue.pop(line_list)) {
+                if (independent_blocks) {
+                    q.clear();  // Blocks never reference lines of earlier blocks
                 }
-                
-                if (new_distance > line.length()) {
-                    record.method = 1;
-                    record.sub_string.push_back(line);
+
+                // Lines visible to the matcher: the window carried over from the
+                // previous block followed by every line of this block
+                std::vector<std::string_view> context;
+                context.reserve(q.size() + line_list.size());
+                for (size_t i = 0; i < q.size(); i++) context.push_back(q[i]);
+                for (size_t i = 0; i < line_list.size(); i++) context.push_back(line_list[i]);
+
+                BlockColumns columns;
+                total_lines += line_list.size();
+
+                // Each line only looks at the previous window_size input lines, so the
+                // block can be split into independent chunks without changing output
+                size_t n = line_list.size();
+                size_t chunk_count = std::max<size_t>(1, std::min<size_t>(threads, n));
+                size_t chunk_size = (n + chunk_count - 1) / chunk_count;
+                std::vector<MatchStats> chunk_stats(chunk_count);
+                if (chunk_count == 1) {
+                    matchLines(context, q.size(), 0, n, window_size, threshold, distance,
+                               use_approx, q_value, sketch_bits, columns, chunk_stats[0]);
                 } else {
-                    record.method = 0;
-                    record.begin = begin;
-                    record.operation_size = op_list.size();
-                    for (const auto& op : op_list) {
-                        record.position_list.push_back(op.position);
-                        record.d_length.push_back(op.length1);
-                        record.i_length.push_back(op.length2);
-                        record.sub_string.push_back(op.substr);
+                    // Every chunk fills its own columns, which are joined in order
+                    std::vector<BlockColumns> chunk_columns(chunk_count);
+                    std::vector<std::future<void>> futures;
+                    for (size_t c = 0; c < chunk_count; c++) {
+                        size_t first = c * chunk_size;
+                        size_t last = std::min(n, first + chunk_size);
+                        futures.push_back(std::async(std::launch::async, [&, c, first, last]() {
+                            matchLines(context, q.size(), first, last, window_size, threshold, distance,
+                                       use_approx, q_value, sketch_bits, chunk_columns[c], chunk_stats[c]);
+                        }));
+                    }
+                    for (auto& f : futures) f.get();
+                    columns = std::move(chunk_columns[0]);
+                    for (size_t c = 1; c < chunk_count; c++) {
+                        columns.append(chunk_columns[c]);
                     }
                 }
-            }
-            records.push_back(record);
-            // printRecord(record, id);
-
-            id++;
+                columns.text_size = line_list.text_size();
+                for (const auto& st : chunk_stats) {
+                    matched_lines += st.matched_lines;
+                    distance_time += st.distance_time;
+                    match_time += st.match_time;
+                }
 
-            auto match_end = std::chrono::high_resolution_clock::now();
-            match_time += std::chrono::duration<double>(match_end - match_start).count();
+                // Update sliding window, then copy it out of the block's arena
+                for (size_t i = 0; i < line_list.size(); i++) {
+                    q.push(line_list[i]);
+                }
+                q.detach(carry);
 
-            // Update sliding window
-            if (q.size() < static_cast<size_t>(window_size)) {
-                q.push_back(line);
-            } else {
-                q.pop_front();
-                q.push_back(line);
+                if (!column_queue.push(std::move(columns))) break;
             }
+        } catch (...) {
+            fail(std::current_exception());
         }
+        column_queue.close();
+    });
 
-        // // Print all records in this block
-        // std::cout << "\n=== Records in this block (total: " << records.size() << ") ===" << std::endl;
-        // for (size_t i = 0; i < records.size(); ++i) {
-        //     printRecord(records[i], i);
-        // }
-        // std::cout << "=== End of block records ===\n" << std::endl;
-
-        // Encode records
-        auto encoding_start = std::chrono::high_resolution_clock::now();
-        // byteArrayEncoding(records, output_path, compressor);
-        byteArrayEncoding(records, output_path, CompressorType::NONE);
-        auto encoding_end = std::chrono::high_resolution_clock::now();
-        encoding_time += std::chrono::duration<double>(encoding_end - encoding_start).count();
+    // Stage 3: encode the columns of a block into its byte layout
+    std::thread encoder([&]() {
+        try {
+            auto encode = [&](const BlockColumns& columns) {
+                auto encoding_start = std::chrono::high_resolution_clock::now();
+                BitOutBuffer block_stream;
+                byteArrayEncoding(columns, block_stream, format_flags, compressor, dictionary.get());
+                std::vector<uint8_t> block_bytes = block_stream.take_bytes();
+                if (independent_blocks) {
+                    // Prefix the block with its byte length so the decoder can find
+                    // it, and with its text size so the text can be placed in the output
+                    uint64_t block_length = block_bytes.size();
+                    block_stream.encode_32(static_cast<uint32_t>(block_length >> 32));
+                    block_stream.encode_32(static_cast<uint32_t>(block_length));
+                    block_stream.encode_32(static_cast<uint32_t>(columns.text_size >> 32));
+                    block_stream.encode_32(static_cast<uint32_t>(columns.text_size));
+                    std::vector<uint8_t> prefixed = block_stream.take_bytes();
+                    prefixed.insert(prefixed.end(), block_bytes.begin(), block_bytes.end());
+                    block_bytes = std::move(prefixed);
+                }
+                auto encoding_end = std::chrono::high_resolution_clock::now();
+                encoding_time += std::chrono::duration<double>(encoding_end - encoding_start).count();
+                return byte_queue.push(std::move(block_bytes));
+            };
+
+            // While a dictionary is to be trained, blocks are held back until
+            // their text is a large enough sample. The header with the
+            // dictionary then goes out ahead of them.
+            constexpr size_t MAX_HELD_BLOCKS = 16;
+            std::deque<BlockColumns> held;
+            std::vector<std::string_view> samples;
+            size_t sample_bytes = 0;
+            auto release = [&]() {
+                std::vector<uint8_t> bytes = ZstdDictionary::train(samples);
+                if (!bytes.empty()) {
+                    dictionary.reset(new ZstdDictionary(std::move(bytes)));
+                }
+                train_dictionary = false;
+                if (!byte_queue.push(header_bytes())) return false;
+                for (const BlockColumns& columns : held) {
+                    if (!encode(columns)) return false;
+                }
+                held.clear();
+                return true;
+            };
+
+            BlockColumns columns;
+            bool open = true;
+            while (open && column_queue.pop(columns)) {
+                if (train_dictionary) {
+                    held.push_back(std::move(columns));
+                    sample_bytes += collectDictionarySamples(held.back(), samples);
+                    if (sample_bytes >= DICTIONARY_SAMPLE_BYTES || held.size() >= MAX_HELD_BLOCKS) {
+                        open = release();
+                    }
+                } else {
+                    open = encode(columns);
+                }
+            }
+            if (open && train_dictionary) {
+                release();
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        byte_queue.close();
+    });
 
-        block_cnt++;
+    // Stage 4 (this thread): compress encoded blocks into the output file
+    double comp_time = 0;
+    try {
+        std::vector<uint8_t> block_bytes;
+        while (byte_queue.pop(block_bytes)) {
+            auto comp_start = std::chrono::high_resolution_clock::now();
+            if (!sink.write(block_bytes)) {
+                throw std::runtime_error("Failed to compress output file: " + sink.path());
+            }
+            auto comp_end = std::chrono::high_resolution_clock::now();
+            comp_time += std::chrono::duration<double>(comp_end - comp_start).count();
+            block_cnt++;
+        }
+    } catch (...) {
+        fail(std::current_exception());
     }
 
-    auto total_end_time = std::chrono::high_resolution_clock::now();
-    double total_time = std::chrono::duration<double>(total_end_time - total_start_time).count();
+    reader.join();
+    matcher.join();
+    encoder.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
 
-    // Secondary compression using specified compressor
     auto comp_start = std::chrono::high_resolution_clock::now();
-    if (!BitCompressor::compress_file(output_path, output_path, compressor)) {
-        throw std::runtime_error("Failed to compress output file: " + output_path);
+    if (!sink.finish()) {
+        throw std::runtime_error("Failed to compress output file: " + sink.path());
     }
     auto comp_end = std::chrono::high_resolution_clock::now();
-    double comp_time = std::chrono::duration<double>(comp_end - comp_start).count();
+    comp_time += std::chrono::duration<double>(comp_end - comp_start).count();
+
+    auto total_end_time = std::chrono::high_resolution_clock::now();
+    double total_time = std::chrono::duration<double>(total_end_time - total_start_time).count();
 
     // Print time statistics
     // std::cout << "Time statistics:" << std::endl;
@@ -418,7 +649,7 @@ double main_encoding_compress(const std::string& input_path,
     // std::cout << "  Q-gram matching time: " << match_time << " seconds" << std::endl;
     // std::cout << "  Encoding time: " << encoding_time << " seconds" << std::endl;
     // std::cout << "  Compressor compression time: " << comp_time << " seconds" << std::endl;
-    std::cout << "Compressing Total time: " << total_time + comp_time << " seconds" << std::endl;
+    std::cout << "Compressing Total time: " << total_time << " seconds" << std::endl;
 
     // // Print matching statistics
     // std::cout << "\nMatching statistics:" << std::endl;
@@ -426,17 +657,21 @@ double main_encoding_compress(const std::string& input_path,
     // std::cout << "  Lines matched: " << matched_lines << std::endl;
     // std::cout << "  Match rate: " << (100.0 * matched_lines / total_lines) << "%" << std::endl;
 
-    // return total_time + comp_time;
-    return total_time + comp_time;
+    return total_time;
 }
 
 #if defined(RECORD_COMPRESS) && !defined(TEST_MODE)
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <input_path> <output_path> [compressor] [window_size] [threshold] [block_size] [distance] [use_approx] [q_value]" << std::endl;
-        std::cerr << "Compressor options: none, lzma, gzip, zstd" << std::endl;
-        std::cerr << "Distance options: cosine, minhash, qgram" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <input_path> <output_path> [compressor] [window_size] [threshold] [block_size] [distance] [use_approx] [q_value] [threads] [independent_blocks] [compressed_sections] [zstd_dictionary] [sketch_bits]" << std::endl;
+        std::cerr << "Compressor options: none, lzma, gzip, zstd, lz4, bzip2" << std::endl;
+        std::cerr << "Distance options: cosine, minhash, qgram, simhash" << std::endl;
         std::cerr << "Use approx options: true, false (default: true)" << std::endl;
+        std::cerr << "Threads: matching threads, 0 = all cores (default: 1)" << std::endl;
+        std::cerr << "Independent blocks options: true, false (default: false)" << std::endl;
+        std::cerr << "Compressed sections options: true, false (default: false)" << std::endl;
+        std::cerr << "Zstd dictionary options: none, auto (train from the first blocks), or a corpus file (default: none)" << std::endl;
+        std::cerr << "Sketch bits options: 8, 16, 32 (default: 32)" << std::endl;
         return 1;
     }
 
@@ -450,6 +685,7 @@ int main(int argc, char* argv[]) {
     int block_size = 327680000;
     std::string distance_setting = "minhash";
     int q_value = 3;  // Default Q value
+    int threads = 1;  // Default single-threaded matching
 
     CompressorType compressor = CompressorType::NONE;
     DistanceType distance = DistanceType::MINHASH;
@@ -466,6 +702,10 @@ int main(int argc, char* argv[]) {
         compressor = CompressorType::GZIP;
     } else if (compressor_setting == "zstd") {
         compressor = CompressorType::ZSTD;
+    } else if (compressor_setting == "lz4") {
+        compressor = CompressorType::LZ4;
+    } else if (compressor_setting == "bzip2") {
+        compressor = CompressorType::BZIP2;
     } else {
         compressor = CompressorType::NONE;
     }
@@ -518,6 +758,8 @@ int main(int argc, char* argv[]) {
         distance = DistanceType::COSINE;
     } else if (distance_setting == "qgram") {
         distance = DistanceType::QGRAM;
+    } else if (distance_setting == "simhash") {
+        distance = DistanceType::SIMHASH;
     } else {
         distance = DistanceType::MINHASH;  // default
     }
@@ -536,6 +778,60 @@ int main(int argc, char* argv[]) {
         q_value = std::stoi(argv[9]);
     }
 
+    // Add threads parameter
+    if (argc > 10 && argv[10] != nullptr) {
+        try {
+            std::string arg(argv[10]);
+            if (!arg.empty()) {
+                threads = std::stoi(arg);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid threads parameter: " << argv[10] << std::endl;
+            return 1;
+        }
+    }
+
+    // Add independent_blocks parameter
+    bool independent_blocks = false;  // Default is false
+    if (argc > 11 && argv[11] != nullptr) {
+        std::string independent_setting = argv[11];
+        if (independent_setting == "true") {
+            independent_blocks = true;
+        }
+    }
+
+    // Add compressed_sections parameter
+    bool compressed_sections = false;  // Default is false
+    if (argc > 12 && argv[12] != nullptr) {
+        std::string sections_setting = argv[12];
+        if (sections_setting == "true") {
+            compressed_sections = true;
+        }
+    }
+
+    // Add zstd_dictionary parameter
+    std::string zstd_dictionary;  // Default is no dictionary
+    if (argc > 13 && argv[13] != nullptr) {
+        std::string dictionary_setting = argv[13];
+        if (dictionary_setting != "none") {
+            zstd_dictionary = dictionary_setting;
+        }
+    }
+
+    // Add sketch_bits parameter
+    int sketch_bits = DefaultParams::SKETCH_BITS;
+    if (argc > 14 && argv[14] != nullptr) {
+        try {
+            std::string arg(argv[14]);
+            if (!arg.empty()) {
+                sketch_bits = std::stoi(arg);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid sketch_bits parameter: " << argv[14] << std::endl;
+            return 1;
+        }
+    }
+
     // Print parameters for verification
     std::cout << "\nUsing parameters:" << std::endl;
     std::cout << "  Compressor: " << compressor_setting << std::endl;
@@ -545,6 +841,11 @@ int main(int argc, char* argv[]) {
     std::cout << "  Distance function: " << distance_setting << std::endl;
     std::cout << "  Use approximation: " << (use_approx ? "true" : "false") << std::endl;
     std::cout << "  Q value: " << q_value << std::endl;
+    std::cout << "  Threads: " << threads << std::endl;
+    std::cout << "  Independent blocks: " << (independent_blocks ? "true" : "false") << std::endl;
+    std::cout << "  Compressed sections: " << (compressed_sections ? "true" : "false") << std::endl;
+    std::cout << "  Zstd dictionary: " << (zstd_dictionary.empty() ? "none" : zstd_dictionary) << std::endl;
+    std::cout << "  Sketch bits: " << sketch_bits << std::endl;
 
     try {
         main_encoding_compress(
@@ -556,7 +857,12 @@ int main(int argc, char* argv[]) {
             compressor,
             distance,
             use_approx,
-            q_value
+            q_value,
+            threads,
+            independent_blocks,
+            compressed_sections,
+            zstd_dictionary,
+            sketch_bits
         );
         
         // std::cout << "Compression completed in " << time_cost << " seconds." << std::endl;
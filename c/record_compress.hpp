@@ -5,6 +5,7 @@
 #include <vector>
 #include "bit_buffer.hpp"
 #include "distance.hpp"
+#include "qgram_match.hpp"
 
 // Global default parameters
 namespace DefaultParams {
@@ -15,24 +16,93 @@ namespace DefaultParams {
     const CompressorType COMPRESSOR = CompressorType::LZMA;
     const DistanceType DISTANCE = DistanceType::MINHASH;
     const bool USE_APPROX = true;
+    const int THREADS = 1;  // Matching threads, 0 = all hardware threads
+    const bool INDEPENDENT_BLOCKS = false;
+    const bool COMPRESSED_SECTIONS = false;
+    const char* const ZSTD_DICTIONARY = "";  // No dictionary
+    const int SKETCH_BITS = 32;  // Bits kept per MinHash value: 8, 16 or 32
 }
 
-// Custom data structure for storing compression records
-struct Record {
-    int method;
-    int another_line;
-    int begin;
-    int operation_size;
-    std::vector<int> position_list;
-    std::vector<int> d_length;
-    std::vector<int> i_length;
-    std::vector<std::string> sub_string;
+// An archive starts with a 16-bit zero, which readers from before the
+// version existed reject as a window size, then the format version (8),
+// the window size (16), the parameter byte and the format flags byte.
+// Readers only accept the version they were built for, since the block
+// layout changes between versions.
+namespace ArchiveVersion {
+    const uint16_t MARKER = 0;
+    const uint8_t CURRENT = 3;
+}
+
+// Bits of the format flags byte that follows the parameter byte
+namespace FormatFlags {
+    // Every block starts with an empty window and is prefixed by its byte
+    // length and the byte size of its decompressed text (64 bits each), so
+    // blocks can be located, decoded and written out independently
+    const uint8_t INDEPENDENT_BLOCKS = 0x1;
+    // Every section of a block is compressed on its own, the text with the
+    // archive's compressor and the integer columns with fast LZ4 or not at
+    // all, instead of the whole archive going through one compressor. The
+    // block layout gains a codec table (see BlockColumn).
+    const uint8_t COMPRESSED_SECTIONS = 0x2;
+    // The flags byte is followed by a zstd dictionary that every
+    // zstd-compressed section of the archive uses: its byte size (32), its
+    // zstd-compressed byte size (32) and the compressed bytes. Only set
+    // together with COMPRESSED_SECTIONS.
+    const uint8_t ZSTD_DICTIONARY = 0x4;
+}
+
+// Column sections of an encoded block, in layout order. A block is
+// records0 (32) | records1 (32) | byte size of each section (64 each) |
+// IntCodec of each integer column (8 each) | sections, and every section
+// starts on a byte boundary so it can be decoded on its own. An integer
+// column is written with int_codec_encode, except that an empty column
+// gives an empty section. With FormatFlags::COMPRESSED_SECTIONS the codec
+// table is followed by the CompressorType (8) and decompressed byte size
+// (64) of each section, and the directory holds the compressed sizes.
+namespace BlockColumn {
+    enum : int {
+        METHOD,          // 0 for a matched line, 1 for a literal one
+        BEGIN,           // reference indexes of method 0 records
+        OPERATION_SIZE,  // operation counts of method 0 records
+        LENGTH,          // d lengths then i lengths of each record
+        POSITION_BEGIN,  // first position of each record
+        POSITION_DELTA,  // position deltas of each record
+        STRING,          // method 0 substrings, then method 1 lines each ending in '\n'
+        COUNT,
+        INTEGER_COUNT = STRING  // The columns before STRING hold integers
+    };
+}
+
+// Columns of a block as the compressor builds them, one entry per line in
+// method, and per method 0 line in begins and operation_sizes. Lines are
+// appended in order, so the encoder writes the columns without regrouping.
+struct BlockColumns {
+    std::vector<int> method;
+    std::vector<int> begins;
+    std::vector<int> operation_sizes;
+    std::vector<int> lengths;          // d lengths then i lengths of each line
+    std::vector<int> position_begins;  // First position of each line with operations
+    std::vector<int> position_deltas;  // Following positions as deltas
+    std::string strings0;              // Method 0 substrings
+    std::string strings1;              // Method 1 lines, each followed by '\n'
+    uint64_t text_size = 0;            // Bytes of the block's lines, '\n's included
+
+    size_t size() const { return method.size(); }
+    size_t records0() const { return begins.size(); }
+    size_t records1() const { return method.size() - begins.size(); }
+
+    void addLiteral(std::string_view line);                             // Method 1
+    void addMatch(int begin, const std::vector<OperationItem>& ops);    // Method 0
+    void append(const BlockColumns& other);  // Add the lines of a later chunk
 };
 
 // Function declarations
-void byteArrayEncoding(const std::vector<Record>& records, 
-                      const std::string& output_path, 
-                      CompressorType compressor = DefaultParams::COMPRESSOR);
+// Encode a block with the layout selected by format_flags. With
+// FormatFlags::COMPRESSED_SECTIONS the text section is compressed with
+// compressor, and zstd uses dictionary if one is given.
+void byteArrayEncoding(const BlockColumns& columns, BitOutBuffer& stream, uint8_t format_flags = 0,
+                       CompressorType compressor = CompressorType::NONE,
+                       const ZstdDictionary* dictionary = nullptr);
 
 double main_encoding_compress(const std::string& input_path, 
                             const std::string& output_path, 
@@ -42,6 +112,11 @@ double main_encoding_compress(const std::string& input_path,
                             CompressorType compressor = DefaultParams::COMPRESSOR,
                             DistanceType distance = DefaultParams::DISTANCE,
                             bool use_approx = DefaultParams::USE_APPROX,
-                            int q_value = DefaultParams::Q);
+                            int q_value = DefaultParams::Q,
+                            int threads = DefaultParams::THREADS,
+                            bool independent_blocks = DefaultParams::INDEPENDENT_BLOCKS,
+                            bool compressed_sections = DefaultParams::COMPRESSED_SECTIONS,
+                            const std::string& zstd_dictionary = DefaultParams::ZSTD_DICTIONARY,
+                            int sketch_bits = DefaultParams::SKETCH_BITS);
 
 #endif // RECORD_COMPRESS_HPP 
\ No newline at end of file
@@ -7,7 +7,10 @@
 #include "record_compress.hpp"
 #include "variable_length_substitution.hpp"
 #include "ts_2diff.hpp"
+#include "int_codec.hpp"
 #include "record_decompress.hpp"
+#include "line_window.hpp"
+#include "output_sink.hpp"
 #include <chrono>
 #include <deque>
 #include <fstream>
@@ -17,377 +20,266 @@
 #include <iomanip>
 #include <future>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
 
 
-/*
-void printRecord(const Record& record, int idx) {
-    std::cout << "Record[" << idx << "]: method=" << record.method
-            //   << ", another_line=" << record.another_line
-              << ", begin=" << record.begin
-              << ", operation_size=" << record.operation_size;
-    std::cout << "  position_list: ";
-    for (auto v : record.position_list) std::cout << v << " ";
-    std::cout << "  d_length: ";
-    for (auto v : record.d_length) std::cout << v << " ";
-    std::cout << "  i_length: ";
-    for (auto v : record.i_length) std::cout << v << " ";
-    std::cout << "  sub_string: ";
-    for (auto& s : record.sub_string) std::cout << '"' << s << '"' << " ";
-    std::cout << std::endl;
-}
-*/
-
-std::vector<Record> byteArrayDecoding(BitInBuffer& stream) {
-    // Detailed timing statistics for this function
-    double rle_decode_time = 0;
-    double bit_packing_decode_time = 0;
-    double ts2diff_decode_time = 0;
-    double string_decode_time = 0;
+bool byteArrayDecoding(BitInBuffer& stream, DecodedColumns& columns, uint8_t format_flags,
+                       bool parallel_columns, const ZstdDictionary* dictionary) {
     // Read record counts
-    int records0_size = stream.decode(32);
-    int records1_size = stream.decode(32);
+    int records0_size = stream.decode_32();
+    int records1_size = stream.decode_32();
     // PRINT_STATS("Records0 size: " << records0_size << ", Records1 size: " << records1_size);
 
     // If both sizes are 0, we've reached the end of a block
     if (records0_size == 0 && records1_size == 0) {
-        return std::vector<Record>();
+        return false;
     }
 
-    // Decode method using RLE - 修复编码/解码不匹配问题
-    auto rle_start = std::chrono::high_resolution_clock::now();
-    int method_length = stream.decode_16();
-    
-    // 需要将字节转换回字符串格式，与压缩时保持一致
-    std::string method_string;
-    method_string.reserve(method_length * 8);
-    for (int i = 0; i < method_length; i++) {
-        int bf = stream.decode_8();
-        method_string += std::bitset<8>(bf).to_string();
+    // Locate the column sections from the directory and skip the stream past them
+    size_t section_size[BlockColumn::COUNT];
+    for (int c = 0; c < BlockColumn::COUNT; c++) {
+        uint64_t size = static_cast<uint64_t>(stream.decode_32()) << 32;
+        size |= stream.decode_32();
+        section_size[c] = size;
     }
-    
-    std::vector<unsigned char> method_bytes = stringToBytes(method_string);
-    size_t method_interval_count = stream.decode_32();
-    std::vector<int> method_list = rleDecode(method_bytes, method_interval_count);
-    auto rle_end = std::chrono::high_resolution_clock::now();
-    rle_decode_time += std::chrono::duration<double>(rle_end - rle_start).count();
-    // PRINT_STATS("Decoded method list size: " << method_list.size());
-
-    // // Decode another_line using RLE
-    // int line_length = stream.decode(16);
-    // std::string line_string;
-    // for (int i = 0; i < line_length; i++) {
-    //     int bf = stream.decode(8);
-    //     line_string += std::bitset<8>(bf).to_string();
-    // }
-    // std::vector<unsigned char> line_bytes = stringToBytes(line_string);
-    // size_t line_interval_count = stream.decode(32);
-    // std::vector<int> another_line_list = rleDecode(line_bytes, line_interval_count);
-    // PRINT_STATS("Decoded Line list size: " << another_line_list.size());
-
-    // Create records array with pre-allocation
-    std::vector<Record> records;
-    records.reserve(records0_size + records1_size);
-    
-    // Pre-allocate all vectors to avoid reallocation
-    std::vector<int> begins;
-    std::vector<int> operation_sizes;
-    std::vector<int> length_list;
-    std::vector<int> p_begin_list;
-    std::vector<int> p_delta_list;
-    
-    if (records0_size > 0) {
-        begins.reserve(records0_size);
-        operation_sizes.reserve(records0_size);
-        
-        // Calculate total lengths needed
-        int total_lengths = 0;
-        for (int i = 0; i < records0_size; i++) {
-            // We need to decode operation_sizes first to know this
-            // So we'll reserve a reasonable estimate
-            total_lengths += 10; // Estimate 10 operations per record
+    IntCodec codecs[BlockColumn::INTEGER_COUNT];
+    for (int c = 0; c < BlockColumn::INTEGER_COUNT; c++) {
+        codecs[c] = static_cast<IntCodec>(stream.decode_8());
+    }
+    const bool compressed_sections = format_flags & FormatFlags::COMPRESSED_SECTIONS;
+    CompressorType section_compressors[BlockColumn::COUNT] = {};
+    size_t raw_sizes[BlockColumn::COUNT];
+    for (int c = 0; c < BlockColumn::COUNT; c++) {
+        if (compressed_sections) {
+            uint8_t compressor = stream.decode_8();
+            if (compressor > static_cast<uint8_t>(CompressorType::BZIP2)) {
+                throw std::runtime_error("Invalid compressor " + std::to_string(compressor) +
+                                         " for column section " + std::to_string(c));
+            }
+            section_compressors[c] = static_cast<CompressorType>(compressor);
+            uint64_t raw_size = static_cast<uint64_t>(stream.decode_32()) << 32;
+            raw_size |= stream.decode_32();
+            raw_sizes[c] = raw_size;
+        } else {
+            raw_sizes[c] = section_size[c];
         }
-        length_list.reserve(total_lengths * 2); // d_length + i_length
-        p_begin_list.reserve(total_lengths);
-        p_delta_list.reserve(total_lengths);
     }
-
-    // Decode begins using bit packing - 修复编码/解码不匹配问题
-    auto bit_packing_start = std::chrono::high_resolution_clock::now();
-    if (records0_size > 0) {
-        int begin_length = stream.decode_16();
-        
-        // 需要将字节转换回字符串格式，与压缩时保持一致
-        std::string bit_packing_string;
-        bit_packing_string.reserve(begin_length * 8);
-        for (int i = 0; i < begin_length; i++) {
-            int bf = stream.decode_8();
-            bit_packing_string += std::bitset<8>(bf).to_string();
+    const uint8_t* section_data[BlockColumn::COUNT];
+    size_t offset = stream.byte_offset();
+    for (int c = 0; c < BlockColumn::COUNT; c++) {
+        if (section_size[c] > stream.size() - offset) {
+            throw std::runtime_error("Column section " + std::to_string(c) + " exceeds the end of the block");
         }
-        
-        std::vector<unsigned char> begins_bytes = stringToBytes(bit_packing_string);
-        begins = bit_packing_decode(begins_bytes, records0_size);
-        // PRINT_STATS("Decoded begins size: " << begins.size());
+        section_data[c] = stream.data() + offset;
+        offset += section_size[c];
     }
+    stream.seek(offset);
+
+    // Decompress a section into storage, or point straight at it when it was
+    // stored as it is
+    auto section_bytes = [&](int c, std::vector<uint8_t>& storage) {
+        if (section_compressors[c] == CompressorType::NONE) {
+            if (raw_sizes[c] != section_size[c]) {
+                throw std::runtime_error("Column section " + std::to_string(c) + " size mismatch");
+            }
+            return section_data[c];
+        }
+        storage.resize(raw_sizes[c]);
+        if (!BitCompressor::decompress_buffer(section_data[c], section_size[c], section_compressors[c], storage,
+                                              dictionary)) {
+            throw std::runtime_error("Failed to decompress column section " + std::to_string(c));
+        }
+        return static_cast<const uint8_t*>(storage.data());
+    };
 
-    // Decode operation_sizes using bit packing - 修复编码/解码不匹配问题
-    if (records0_size > 0) {
-        int operation_length = stream.decode_16();
-        
-        // Direct byte array with batch decode
-        std::vector<unsigned char> sizes_bytes(operation_length);
-        stream.decode_bytes(sizes_bytes.data(), operation_length);
-        
-        operation_sizes = bit_packing_decode(sizes_bytes, records0_size);
-        // PRINT_STATS("Decoded operation size: " << operation_sizes.size());
+    // Decode the integer columns, concurrently when parallel_columns is set
+    const std::launch policy = parallel_columns ? std::launch::async : std::launch::deferred;
+    auto decode_column = [&](int c) {
+        if (raw_sizes[c] == 0) return std::vector<int>();
+        std::vector<uint8_t> storage;
+        BitInBuffer column;
+        column.attach(section_bytes(c, storage), raw_sizes[c]);
+        return int_codec_decode(codecs[c], column);
+    };
+
+    auto text_future = std::async(policy, [&]() {
+        return section_bytes(BlockColumn::STRING, columns.text);
+    });
+    auto method_future = std::async(policy, decode_column, BlockColumn::METHOD);
+    auto begins_future = std::async(policy, decode_column, BlockColumn::BEGIN);
+    auto operation_sizes_future = std::async(policy, decode_column, BlockColumn::OPERATION_SIZE);
+    auto length_future = std::async(policy, decode_column, BlockColumn::LENGTH);
+    auto p_begin_future = std::async(policy, decode_column, BlockColumn::POSITION_BEGIN);
+    auto p_delta_future = std::async(policy, decode_column, BlockColumn::POSITION_DELTA);
+
+    columns.method = method_future.get();
+    columns.begins = begins_future.get();
+    columns.operation_sizes = operation_sizes_future.get();
+    columns.lengths = length_future.get();
+    columns.position_begins = p_begin_future.get();
+    columns.position_deltas = p_delta_future.get();
+    const std::vector<int>& method_list = columns.method;
+    const std::vector<int>& operation_sizes = columns.operation_sizes;
+    const std::vector<int>& length_list = columns.lengths;
+
+    // Validate the column sizes against the record counts
+    if (method_list.size() != static_cast<size_t>(records0_size + records1_size) ||
+        std::count(method_list.begin(), method_list.end(), 0) != records0_size) {
+        throw std::runtime_error("Method list size mismatch: expected " +
+                               std::to_string(records0_size) + " + " + std::to_string(records1_size) +
+                               " records, got " + std::to_string(method_list.size()));
     }
-    auto bit_packing_end = std::chrono::high_resolution_clock::now();
-    bit_packing_decode_time += std::chrono::duration<double>(bit_packing_end - bit_packing_start).count();
-
-    // Create temporary array to store method 0 data
-    int record0_idx = 0;  // Used to track current processing record of method 0
-
-    // Decode lengths
-    auto ts2diff_start = std::chrono::high_resolution_clock::now();
-    if (records0_size > 0) {
-        int total_lengths = 0;
-        for (int i = 0; i < records0_size; i++) {
-            total_lengths += operation_sizes[i] * 2;
-        }
-        length_list = ts2diff_decode(stream);
-        // PRINT_STATS("Decoded lengths size: " << length_list.size());
-
-        // Validate if length_list size is correct
-        if (length_list.size() != static_cast<size_t>(total_lengths)) {
-            throw std::runtime_error("Length list size mismatch: expected " + 
-                                   std::to_string(total_lengths) + ", got " + 
-                                   std::to_string(length_list.size()));
+    if (columns.begins.size() != static_cast<size_t>(records0_size) ||
+        operation_sizes.size() != static_cast<size_t>(records0_size)) {
+        throw std::runtime_error("Record list size mismatch: expected " + std::to_string(records0_size) +
+                               " begins and operation sizes, got " + std::to_string(columns.begins.size()) +
+                               " and " + std::to_string(operation_sizes.size()));
+    }
+    size_t total_operations = 0;
+    size_t non_empty_records = 0;
+    for (int i = 0; i < records0_size; i++) {
+        if (operation_sizes[i] < 0) {
+            throw std::runtime_error("Negative operation size in record " + std::to_string(i));
         }
+        total_operations += operation_sizes[i];
+        non_empty_records += operation_sizes[i] > 0 ? 1 : 0;
+    }
+    if (length_list.size() != total_operations * 2) {
+        throw std::runtime_error("Length list size mismatch: expected " + 
+                               std::to_string(total_operations * 2) + ", got " + 
+                               std::to_string(length_list.size()));
+    }
+    if (columns.position_begins.size() != non_empty_records ||
+        columns.position_deltas.size() != total_operations - non_empty_records) {
+        throw std::runtime_error("Position list size mismatch: expected " +
+                               std::to_string(non_empty_records) + " begins and " +
+                               std::to_string(total_operations - non_empty_records) + " deltas");
     }
 
-    // Decode positions
-    if (records0_size > 0) {
-        p_begin_list = ts2diff_decode(stream);
-        // PRINT_STATS("Total begin positions: " << p_begin_list.size());
-        p_delta_list = ts2diff_decode(stream);
-        // PRINT_STATS("Total delta positions: " << p_delta_list.size());
+    // Split the string section: method 0 substrings come first, followed by
+    // the method 1 lines
+    const char* strings = reinterpret_cast<const char*>(text_future.get());
+    const size_t string_size = raw_sizes[BlockColumn::STRING];
+    size_t total_chars = 0;
+    for (size_t i = 0, length_idx = 0; i < static_cast<size_t>(records0_size); i++) {
+        length_idx += operation_sizes[i];  // Skip d lengths
+        for (int j = 0; j < operation_sizes[i]; j++) {
+            int i_length = length_list[length_idx++];
+            if (i_length < 0) {
+                throw std::runtime_error("Negative insert length in record " + std::to_string(i));
+            }
+            total_chars += i_length;
+        }
     }
-    auto ts2diff_end = std::chrono::high_resolution_clock::now();
-    ts2diff_decode_time += std::chrono::duration<double>(ts2diff_end - ts2diff_start).count();
-
-    // First, decode all fields of method0 and method1 - with pre-allocation
-    struct Method0Fields {
-        // int another_line;
-        int begin;
-        int operation_size;
-        std::vector<int> position_list;
-        std::vector<int> d_length;
-        std::vector<int> i_length;
-        std::vector<std::string> sub_string;
-        
-        // Constructor with pre-allocation
-        Method0Fields(int op_size) : operation_size(op_size) {
-            position_list.reserve(op_size);
-            d_length.reserve(op_size);
-            i_length.reserve(op_size);
-            sub_string.reserve(op_size);
+    if (total_chars > string_size) {
+        throw std::runtime_error("String section too short: expected at least " +
+                               std::to_string(total_chars) + " bytes, got " +
+                               std::to_string(string_size));
+    }
+    columns.strings0 = std::string_view(strings, total_chars);
+    columns.strings1 = std::string_view(strings + total_chars, string_size - total_chars);
+    return true;
+}
+
+// Apply the operations of one method 0 line to its reference. Unchanged
+// reference bytes are clamped the way std::string::substr clamps them, so
+// lines come out exactly as recoverQgramString/recoverSubstitutionString
+// build them. With WRITE false only the length of the line is computed.
+template <bool WRITE>
+static size_t applyOperations(std::string_view reference, int operation_size,
+                              const int* d_length, const int* i_length,
+                              int first_position, const int* position_deltas,
+                              const char* substrings, char* out) {
+    size_t written = 0;
+    size_t old_pos = 0;
+    int position = first_position;
+    auto copy_reference = [&](size_t from, size_t count) {
+        if (from > reference.size()) {
+            throw std::runtime_error("Operation starts past the end of its reference line");
         }
+        count = std::min(count, reference.size() - from);
+        if (WRITE) std::memcpy(out + written, reference.data() + from, count);
+        written += count;
     };
-    struct Method1Fields {
-        // int another_line;
-        std::string sub_string;
-        
-        Method1Fields() {
-            sub_string.reserve(256);  // Pre-allocate reasonable size
+    for (int j = 0; j < operation_size; j++) {
+        if (j > 0) position += position_deltas[j - 1];
+        copy_reference(old_pos, static_cast<size_t>(position) - old_pos);
+        if (WRITE) std::memcpy(out + written, substrings, i_length[j]);
+        written += i_length[j];
+        substrings += i_length[j];
+        old_pos = static_cast<size_t>(position + d_length[j]);
+    }
+    copy_reference(old_pos, std::string::npos);
+    return written;
+}
+
+// Rebuild the lines of one block into arena, copying each piece straight
+// from the reference line or the string column. q is the sliding window of
+// previously rebuilt lines and is updated in place; it may point into arena.
+static void recoverBlock(const DecodedColumns& columns, LineWindow& q, LineArena& arena) {
+    const char* string0 = columns.strings0.data();
+    const char* string1 = columns.strings1.data();
+    const char* strings1_end = string1 + columns.strings1.size();
+    size_t record0_idx = 0, length_idx = 0, begin_idx = 0, delta_idx = 0;
+
+    // Append a line of size bytes to arena; window lines of this block move
+    // with the arena when it grows
+    auto append_line = [&](size_t size) {
+        const char* old_data = arena.data();
+        size_t old_size = arena.bytes().size();
+        char* out = arena.append(size);
+        if (arena.data() != old_data) {
+            q.rebase(old_data, old_size, arena.data());
         }
+        return out;
     };
-    
-    // Pre-allocate vectors
-    std::vector<Method0Fields> method0_vec;
-    method0_vec.reserve(records0_size);
-    std::vector<Method1Fields> method1_vec;
-    method1_vec.reserve(records1_size);
-
-    // Decode method0 - optimized with pre-allocation
-    record0_idx = 0;
-    int length_idx = 0, begin_idx = 0, delta_idx = 0;
-    for (size_t i = 0; i < method_list.size(); i++) {
-        if (method_list[i] == 0) {
-            Method0Fields m0(operation_sizes[record0_idx]);  // Pre-allocate with known size
-            // m0.another_line = another_line_list[i];
-            m0.begin = begins[record0_idx];
-            m0.operation_size = operation_sizes[record0_idx];
-            
-            // Decode positions based on operation_size - optimized
-            if (m0.operation_size > 0) {
-                m0.position_list.resize(m0.operation_size);
-                int pos = p_begin_list[begin_idx++];
-                m0.position_list[0] = pos;
-                
-                // Unroll loop for better performance
-                int pos_j = 1;
-                for (; pos_j + 4 <= m0.operation_size; pos_j += 4) {
-                    pos += p_delta_list[delta_idx++];
-                    m0.position_list[pos_j] = pos;
-                    pos += p_delta_list[delta_idx++];
-                    m0.position_list[pos_j+1] = pos;
-                    pos += p_delta_list[delta_idx++];
-                    m0.position_list[pos_j+2] = pos;
-                    pos += p_delta_list[delta_idx++];
-                    m0.position_list[pos_j+3] = pos;
-                }
-                for (; pos_j < m0.operation_size; pos_j++) {
-                    pos += p_delta_list[delta_idx++];
-                    m0.position_list[pos_j] = pos;
-                }
-                
-                // Decode lengths based on operation_size - optimized
-                m0.d_length.resize(m0.operation_size);
-                m0.i_length.resize(m0.operation_size);
-                
-                // Unroll small loops for better performance
-                int len_j = 0;
-                for (; len_j + 4 <= m0.operation_size; len_j += 4) {
-                    m0.d_length[len_j] = length_list[length_idx++];
-                    m0.d_length[len_j+1] = length_list[length_idx++];
-                    m0.d_length[len_j+2] = length_list[length_idx++];
-                    m0.d_length[len_j+3] = length_list[length_idx++];
-                }
-                for (; len_j < m0.operation_size; len_j++) {
-                    m0.d_length[len_j] = length_list[length_idx++];
-                }
-                
-                len_j = 0;
-                for (; len_j + 4 <= m0.operation_size; len_j += 4) {
-                    m0.i_length[len_j] = length_list[length_idx++];
-                    m0.i_length[len_j+1] = length_list[length_idx++];
-                    m0.i_length[len_j+2] = length_list[length_idx++];
-                    m0.i_length[len_j+3] = length_list[length_idx++];
-                }
-                for (; len_j < m0.operation_size; len_j++) {
-                    m0.i_length[len_j] = length_list[length_idx++];
-                }
-                
-                // Decode substrings based on operation_size - optimized batch
-                auto string_decode_start = std::chrono::high_resolution_clock::now();
-                m0.sub_string.reserve(m0.operation_size);  // Pre-allocate vector
-                
-                // Batch decode all characters at once for better performance
-                int total_chars = 0;
-                for (int j = 0; j < m0.operation_size; j++) {
-                    total_chars += m0.i_length[j];
-                }
-                
-                // Decode all characters in one batch - unrolled loop for small sizes
-                std::string all_chars(total_chars, '\0');
-                uint8_t* buffer = reinterpret_cast<uint8_t*>(all_chars.data());
-                
-                // Unroll small loops for better performance
-                size_t i = 0;
-                for (; i + 8 <= static_cast<size_t>(total_chars); i += 8) {
-                    buffer[i] = stream.decode_8();
-                    buffer[i+1] = stream.decode_8();
-                    buffer[i+2] = stream.decode_8();
-                    buffer[i+3] = stream.decode_8();
-                    buffer[i+4] = stream.decode_8();
-                    buffer[i+5] = stream.decode_8();
-                    buffer[i+6] = stream.decode_8();
-                    buffer[i+7] = stream.decode_8();
-                }
-                
-                // Handle remaining bytes
-                for (; i < static_cast<size_t>(total_chars); i++) {
-                    buffer[i] = stream.decode_8();
-                }
-                
-                // Split into substrings
-                int char_pos = 0;
-                for (int j = 0; j < m0.operation_size; j++) {
-                    int len = m0.i_length[j];
-                    m0.sub_string.emplace_back(all_chars, char_pos, len);
-                    char_pos += len;
-                }
-                
-                auto string_decode_end = std::chrono::high_resolution_clock::now();
-                string_decode_time += std::chrono::duration<double>(string_decode_end - string_decode_start).count();
+
+    for (size_t i = 0; i < columns.method.size(); i++) {
+        if (columns.method[i] == 0) {
+            int begin = columns.begins[record0_idx];
+            int operation_size = columns.operation_sizes[record0_idx];
+            record0_idx++;
+            // Check if we have enough records in the window
+            if (begin < 0 || begin >= static_cast<int>(q.size())) {
+                throw std::runtime_error("Invalid reference index: " + std::to_string(begin) + 
+                                       ", window size: " + std::to_string(q.size()));
             }
-            
-            // Validate array sizes
-            if (m0.position_list.size() != static_cast<size_t>(m0.operation_size) ||
-                m0.d_length.size() != static_cast<size_t>(m0.operation_size) ||
-                m0.i_length.size() != static_cast<size_t>(m0.operation_size) ||
-                m0.sub_string.size() != static_cast<size_t>(m0.operation_size)) {
-                throw std::runtime_error("Array size mismatch in record " + std::to_string(i) + 
-                    ": operation_size=" + std::to_string(m0.operation_size) +
-                    ", position_list=" + std::to_string(m0.position_list.size()) +
-                    ", d_length=" + std::to_string(m0.d_length.size()) +
-                    ", i_length=" + std::to_string(m0.i_length.size()) +
-                    ", sub_string=" + std::to_string(m0.sub_string.size()));
+            const int* d_length = columns.lengths.data() + length_idx;
+            const int* i_length = d_length + operation_size;
+            length_idx += 2 * operation_size;
+            int first_position = operation_size > 0 ? columns.position_begins[begin_idx++] : 0;
+            const int* position_deltas = columns.position_deltas.data() + delta_idx;
+            delta_idx += operation_size > 0 ? operation_size - 1 : 0;
+
+            size_t size = applyOperations<false>(q[begin], operation_size, d_length, i_length,
+                                                 first_position, position_deltas, string0, nullptr);
+            char* out = append_line(size);
+            applyOperations<true>(q[begin], operation_size, d_length, i_length,
+                                  first_position, position_deltas, string0, out);
+            for (int j = 0; j < operation_size; j++) {
+                string0 += i_length[j];
             }
-            
-            method0_vec.push_back(m0);
-            record0_idx++;
-        }
-    }
-    // Decode method1
-    for (size_t i = 0; i < method_list.size(); i++) {
-        if (method_list[i] == 1) {
-            Method1Fields m1;  // Constructor already pre-allocates
-            // m1.another_line = another_line_list[i];
-            
-            // Optimized: read until newline
-            char byte;
-            do {
-                byte = static_cast<char>(stream.decode_8());
-                if (byte != '\n') {
-                    m1.sub_string += byte;
-                }
-            } while (byte != '\n');
-            
-            method1_vec.push_back(std::move(m1));  // Use move semantics
-        }
-    }
-    // Reconstruct records based on method_list order
-    size_t idx0 = 0, idx1 = 0;
-    for (size_t i = 0; i < method_list.size(); ++i) {
-        if (method_list[i] == 0) {
-            const auto& m0 = method0_vec[idx0++];
-            Record record;
-            record.method = 0;
-            // record.another_line = m0.another_line;
-            record.begin = m0.begin;
-            record.operation_size = m0.operation_size;
-            record.position_list = m0.position_list;
-            record.d_length = m0.d_length;
-            record.i_length = m0.i_length;
-            record.sub_string = m0.sub_string;
-            records.push_back(record);
         } else {
-            const auto& m1 = method1_vec[idx1++];
-            Record record;
-            record.method = 1;
-            // record.another_line = m1.another_line;
-            record.begin = 0;
-            record.operation_size = 0;
-            record.position_list.clear();
-            record.d_length.clear();
-            record.i_length.clear();
-            record.sub_string = {m1.sub_string};
-            records.push_back(record);
+            // Method 1 lines end with '\n'
+            const char* line_end = static_cast<const char*>(
+                std::memchr(string1, '\n', strings1_end - string1));
+            if (line_end == nullptr) {
+                throw std::runtime_error("Unterminated line in string section of record " + std::to_string(i));
+            }
+            size_t size = line_end - string1;
+            std::memcpy(append_line(size), string1, size);
+            string1 = line_end + 1;
         }
+        q.push(arena[arena.size() - 1]);
     }
-
-    // Print detailed timing statistics for this function
-    // std::cout << "  byteArrayDecoding detailed timing:" << std::endl;
-    // std::cout << "    - RLE decode time: " << rle_decode_time << " seconds" << std::endl;
-    // std::cout << "    - Bit packing decode time: " << bit_packing_decode_time << " seconds" << std::endl;
-    // std::cout << "    - TS2Diff decode time: " << ts2diff_decode_time << " seconds" << std::endl;
-    // std::cout << "    - String decode time: " << string_decode_time << " seconds" << std::endl;
-
-    return records;
 }
 
 double main_decoding_decompress(const std::string& input_path, 
-                               const std::string& output_path) {
+                               const std::string& output_path,
+                               int threads) {
     auto total_start_time = std::chrono::high_resolution_clock::now();
 
     // Time statistics for each part
@@ -396,143 +288,226 @@ double main_decoding_decompress(const std::string& input_path,
     double recovery_time = 0;
     // double write_time = 0;
     
-    // Detailed timing statistics for recovery
-    double qgram_recovery_time = 0;
-    double substitution_recovery_time = 0;
+
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
 
     // Read encoding head
     // auto read_start = std::chrono::high_resolution_clock::now();
 
     BitInBuffer stream;
-    stream.read(input_path);
+    if (!stream.read(input_path, threads)) {
+        throw std::runtime_error("Failed to read input file: " + input_path);
+    }
     
-    int window_size = stream.decode(16);
+    // Older archives start with their window size instead of the marker
+    if (stream.size() < 3 || stream.decode_16() != ArchiveVersion::MARKER ||
+        stream.decode_8() != ArchiveVersion::CURRENT) {
+        throw std::runtime_error("Unsupported archive version: " + input_path);
+    }
+
+    int window_size = stream.decode_16();
     if (window_size == 0) {
         std::cerr << "Error: Window size is 0, this is invalid." << std::endl;
         throw std::runtime_error("Invalid window size: 0");
     }
     
     
-    uint8_t param_byte = stream.decode(8);
-    bool use_approx = (param_byte >> 7) & 0x1;
+    // The parameter byte only describes how lines were matched, lines of
+    // either matcher are rebuilt the same way
+    uint8_t param_byte = stream.decode_8();
+    (void)param_byte;
+    uint8_t format_flags = stream.decode_8();
+    bool independent_blocks = format_flags & FormatFlags::INDEPENDENT_BLOCKS;
+    std::unique_ptr<ZstdDictionary> dictionary;
+    if (format_flags & FormatFlags::ZSTD_DICTIONARY) {
+        size_t dictionary_size = stream.decode_32();
+        size_t compressed_size = stream.decode_32();
+        if (compressed_size > stream.size() - stream.byte_offset() ||
+            dictionary_size > ZstdDictionary::MAX_CAPACITY) {
+            throw std::runtime_error("Invalid zstd dictionary size");
+        }
+        std::vector<uint8_t> bytes(dictionary_size);
+        const uint8_t* compressed = stream.data() + stream.byte_offset();
+        if (!BitCompressor::decompress_buffer(compressed, compressed_size, CompressorType::ZSTD, bytes)) {
+            throw std::runtime_error("Failed to decompress the zstd dictionary");
+        }
+        stream.seek(stream.byte_offset() + compressed_size);
+        dictionary.reset(new ZstdDictionary(std::move(bytes)));
+        if (!dictionary->valid()) {
+            throw std::runtime_error("Invalid zstd dictionary");
+        }
+    }
     // auto read_end = std::chrono::high_resolution_clock::now();
     // read_time = std::chrono::duration<double>(read_end - read_start).count();
 
-    std::deque<std::string> q;
-    std::ofstream output(output_path);
-    if (!output.is_open()) {
+    OutputSink output;
+    if (!output.open(output_path)) {
         throw std::runtime_error("Failed to open output file: " + output_path);
     }
+    auto write_output = [&](const char* data, size_t size) {
+        if (!output.write(data, size)) {
+            throw std::runtime_error("Failed to write output file: " + output_path);
+        }
+    };
 
     try {
-        // Process blocks until end of file
-        auto last_recovery_end = std::chrono::high_resolution_clock::now();
-        while (true) {
-            try {
-                // Decode records for current block
+        if (independent_blocks) {
+            // Locate every block from its prefix: byte length and text size
+            struct BlockInfo {
+                size_t offset;
+                size_t length;
+                uint64_t text_size;
+                uint64_t text_offset;  // Position of the block's text in the output
+            };
+            std::vector<BlockInfo> blocks;
+            size_t offset = stream.byte_offset();
+            uint64_t text_offset = 0;
+            while (offset + 16 <= stream.size()) {
+                stream.seek(offset);
+                uint64_t block_length = static_cast<uint64_t>(stream.decode_32()) << 32;
+                block_length |= stream.decode_32();
+                uint64_t text_size = static_cast<uint64_t>(stream.decode_32()) << 32;
+                text_size |= stream.decode_32();
+                offset += 16;
+                if (block_length > stream.size() - offset) {
+                    throw std::runtime_error("Truncated block at offset " + std::to_string(offset));
+                }
+                blocks.push_back({offset, static_cast<size_t>(block_length), text_size, text_offset});
+                offset += block_length;
+                text_offset += text_size;
+            }
+
+            // Each block is decoded with its own window
+            struct BlockResult {
+                LineArena lines;
+                double decoding_time = 0;
+                double recovery_time = 0;
+            };
+            auto decode_block = [&](size_t b) {
+                BlockResult result;
+                BitInBuffer block_stream;
+                block_stream.attach(stream.data() + blocks[b].offset, blocks[b].length);
+
                 auto decode_start = std::chrono::high_resolution_clock::now();
-                std::vector<Record> records = byteArrayDecoding(stream);
+                DecodedColumns columns;
+                byteArrayDecoding(block_stream, columns, format_flags, false, dictionary.get());
                 auto decode_end = std::chrono::high_resolution_clock::now();
-                decoding_time += std::chrono::duration<double>(decode_end - decode_start).count();
-
-                // If no records were decoded, we've reached the end
-                if (records.empty()) {
-                    break;
+                result.decoding_time = std::chrono::duration<double>(decode_end - decode_start).count();
+
+                LineWindow q(window_size);
+                recoverBlock(columns, q, result.lines);
+                auto recovery_end = std::chrono::high_resolution_clock::now();
+                result.recovery_time = std::chrono::duration<double>(recovery_end - decode_end).count();
+                if (result.lines.text_size() != blocks[b].text_size) {
+                    throw std::runtime_error("Block " + std::to_string(b) + " text size mismatch: expected " +
+                                           std::to_string(blocks[b].text_size) + ", got " +
+                                           std::to_string(result.lines.text_size()));
                 }
-                
-                // Process each record in the block
-                int record_count = 0;
-                auto recovery_start = std::chrono::high_resolution_clock::now();
-                for (const auto& record : records) {
-                    std::string line;
-                    if (record.method == 0) {
-                        // Check if we have enough records in the window
-                        if (record.begin >= static_cast<int>(q.size())) {
-                            std::cerr << "Error at record " << record_count << ":" << std::endl;
-                            std::cerr << "  Method: " << record.method << std::endl;
-                            std::cerr << "  Begin: " << record.begin << std::endl;
-                            std::cerr << "  Window size: " << q.size() << std::endl;
-                            std::cerr << "  Operation size: " << record.operation_size << std::endl;
-                            std::cerr << "  Position list size: " << record.position_list.size() << std::endl;
-                            std::cerr << "  D length size: " << record.d_length.size() << std::endl;
-                            std::cerr << "  I length size: " << record.i_length.size() << std::endl;
-                            std::cerr << "  Sub string size: " << record.sub_string.size() << std::endl;
-                            throw std::runtime_error("Invalid reference index: " + std::to_string(record.begin) + 
-                                                   ", window size: " + std::to_string(q.size()));
-                        }
-                        // Reconstruct line from reference
-                        line = q[record.begin];
-                        if (use_approx) {
-                            // Use Q-gram matching recovery - optimized
-                            auto qgram_start = std::chrono::high_resolution_clock::now();
-                            std::vector<OperationItem> ops;
-                            ops.reserve(record.position_list.size());  // Pre-allocate
-                            for (size_t i = 0; i < record.position_list.size(); i++) {
-                                ops.emplace_back(record.position_list[i], 
-                                              record.d_length[i],
-                                              record.i_length[i],
-                                              record.sub_string[i]);
-                            }
-                            line = recoverQgramString(ops, line);
-                            auto qgram_end = std::chrono::high_resolution_clock::now();
-                            qgram_recovery_time += std::chrono::duration<double>(qgram_end - qgram_start).count();
-                        } else {
-                            // Use exact substitution recovery - optimized
-                            auto sub_start = std::chrono::high_resolution_clock::now();
-                            std::vector<OperationItem> ops;
-                            ops.reserve(record.position_list.size());  // Pre-allocate
-                            for (size_t i = 0; i < record.position_list.size(); i++) {
-                                ops.emplace_back(record.position_list[i], 
-                                              record.d_length[i],
-                                              record.i_length[i],
-                                              record.sub_string[i]);
-                            }
-                            line = recoverSubstitutionString(ops, line);
-                            auto sub_end = std::chrono::high_resolution_clock::now();
-                            substitution_recovery_time += std::chrono::duration<double>(sub_end - sub_start).count();
+                return result;
+            };
+
+            if (output.positional()) {
+                // Size the output file up front; workers take the next block
+                // and write its text in place as soon as it is decoded
+                if (!output.preallocate(text_offset)) {
+                    throw std::runtime_error("Failed to allocate output file: " + output_path);
+                }
+                std::atomic<size_t> next_block(0);
+                std::mutex time_mutex;
+                auto worker = [&]() {
+                    for (size_t b = next_block++; b < blocks.size(); b = next_block++) {
+                        BlockResult result = decode_block(b);
+                        if (!output.writeAt(result.lines.data(), result.lines.text_size(), blocks[b].text_offset)) {
+                            throw std::runtime_error("Failed to write output file: " + output_path);
                         }
-                    } else {
-                        // Direct output for method 1
-                        line = record.sub_string[0];
+                        std::lock_guard<std::mutex> lock(time_mutex);
+                        decoding_time += result.decoding_time;
+                        recovery_time += result.recovery_time;
                     }
-
-                    record_count++;
-
-                    // // Write the line to output
-                    // if (record.another_line == 1) {
-                    //     // If another_line is 1, remove the trailing newline
-                    //     if (!line.empty() && line.back() == '\n') {
-                    //         line.pop_back();
-                    //     }
-                    //     output << line;  // Don't add newline for another_line=1
-                    // } else {
-                    //     output << line << std::endl;  // Add newline for another_line=0
-                    // }
-
-                    output << line << std::endl;
-
-                    // Update sliding window
-                    if (q.size() < static_cast<size_t>(window_size)) {
-                        q.push_back(line);
-                    } else {
-                        q.pop_front();
-                        q.push_back(line);
+                };
+                size_t worker_count = std::min(blocks.size(), static_cast<size_t>(threads));
+                std::vector<std::future<void>> workers;
+                for (size_t w = 1; w < worker_count; w++) {
+                    workers.push_back(std::async(std::launch::async, worker));
+                }
+                std::exception_ptr error;
+                try {
+                    worker();
+                } catch (...) {
+                    error = std::current_exception();
+                    next_block = blocks.size();  // Stop the other workers
+                }
+                for (auto& w : workers) {
+                    try {
+                        w.get();
+                    } catch (...) {
+                        if (!error) error = std::current_exception();
+                        next_block = blocks.size();
+                    }
+                }
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+            } else {
+                // Pipes and stdout are written in block order, decoding blocks
+                // in waves of `threads`
+                for (size_t wave = 0; wave < blocks.size(); wave += threads) {
+                    size_t wave_end = std::min(blocks.size(), wave + static_cast<size_t>(threads));
+                    std::vector<std::future<BlockResult>> futures;
+                    for (size_t b = wave; b < wave_end; b++) {
+                        futures.push_back(std::async(threads > 1 ? std::launch::async : std::launch::deferred,
+                                                     decode_block, b));
+                    }
+                    for (auto& future : futures) {
+                        BlockResult result = future.get();
+                        write_output(result.lines.data(), result.lines.text_size());
+                        decoding_time += result.decoding_time;
+                        recovery_time += result.recovery_time;
                     }
                 }
-                last_recovery_end = std::chrono::high_resolution_clock::now();
-                recovery_time += std::chrono::duration<double>(last_recovery_end - recovery_start).count();
+            }
+        } else {
+            // Blocks share the sliding window, so they are decoded in order
+            LineWindow q(window_size);
+            std::string carry;  // Window lines of the previous block
+            LineArena arena;
+            DecodedColumns columns;
+            while (true) {
+                try {
+                    // Decode columns for current block
+                    auto decode_start = std::chrono::high_resolution_clock::now();
+                    bool has_records = byteArrayDecoding(stream, columns, format_flags, threads > 1, dictionary.get());
+                    auto decode_end = std::chrono::high_resolution_clock::now();
+                    decoding_time += std::chrono::duration<double>(decode_end - decode_start).count();
+
+                    // If no records were decoded, we've reached the end
+                    if (!has_records) {
+                        break;
+                    }
 
-            } catch (const std::runtime_error& e) {
-                // If we get an end of file error, we're done
-                if (std::string(e.what()).find("Attempting to read past end of buffer") != std::string::npos) {
-                    break;
+                    recoverBlock(columns, q, arena);
+                    write_output(arena.data(), arena.text_size());
+                    q.detach(carry);
+                    arena.clear();
+                    auto recovery_end = std::chrono::high_resolution_clock::now();
+                    recovery_time += std::chrono::duration<double>(recovery_end - decode_end).count();
+
+                } catch (const std::runtime_error& e) {
+                    // If we get an end of file error, we're done
+                    if (std::string(e.what()).find("Attempting to read past end of buffer") != std::string::npos) {
+                        break;
+                    }
+                    // Otherwise, rethrow the error
+                    throw;
                 }
-                // Otherwise, rethrow the error
-                throw;
             }
         }
 
-        output.close();
+        if (!output.close()) {
+            throw std::runtime_error("Failed to write output file: " + output_path);
+        }
         // auto write_end = std::chrono::high_resolution_clock::now();
         // write_time = std::chrono::duration<double>(write_end - last_recovery_end).count();
 
@@ -550,10 +525,9 @@ double main_decoding_decompress(const std::string& input_path,
     // std::cout << "  Read time: " << read_time << " seconds" << std::endl;
     // std::cout << "  Decoding time: " << decoding_time << " seconds" << std::endl;
     // std::cout << "  Recovery time: " << recovery_time << " seconds" << std::endl;
-    // std::cout << "    - Q-gram recovery time: " << qgram_recovery_time << " seconds" << std::endl;
-    // std::cout << "    - Substitution recovery time: " << substitution_recovery_time << " seconds" << std::endl;
     // std::cout << "  Write time: " << write_time << " seconds" << std::endl;
-    std::cout << "Decompressing Total time: " << total_time << " seconds" << std::endl;
+    // Keep stdout clean when the text itself goes there
+    (output_path == "-" ? std::cerr : std::cout) << "Decompressing Total time: " << total_time << " seconds" << std::endl;
 
     return total_time;
 }
@@ -561,17 +535,32 @@ double main_decoding_decompress(const std::string& input_path,
 #ifdef RECORD_DECOMPRESS
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " <input_path> <output_path>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " <input_path> <output_path> [threads]" << std::endl;
+        std::cerr << "Threads: block decoding threads for archives with independent blocks, 0 = all cores (default: 1)" << std::endl;
         return 1;
     }
 
     std::string input_path = argv[1];
     std::string output_path = argv[2];
 
+    int threads = 1;
+    if (argc > 3 && argv[3] != nullptr) {
+        try {
+            std::string arg(argv[3]);
+            if (!arg.empty()) {
+                threads = std::stoi(arg);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid threads parameter: " << argv[3] << std::endl;
+            return 1;
+        }
+    }
+
     try {
         double time_cost = main_decoding_decompress(
             input_path, 
-            output_path
+            output_path,
+            threads
         );
         
         // Use time_cost to avoid unused variable warning
@@ -17,6 +17,7 @@
 #include <bitset>
 #include <stdexcept>
 #include <iomanip>
+#include <string_view>
 
 // Define macro for decoding statistics output
 #ifndef DECODING_STATS
@@ -25,10 +26,27 @@
 
 #define PRINT_STATS(x) if (DECODING_STATS) { std::cout << x << std::endl; }
 
+// Columns of a decoded block, read with cursors to rebuild its lines. The
+// string columns are views into the buffer the block was decoded from.
+struct DecodedColumns {
+    std::vector<int> method;
+    std::vector<int> begins;
+    std::vector<int> operation_sizes;
+    std::vector<int> lengths;          // d lengths then i lengths of each line
+    std::vector<int> position_begins;
+    std::vector<int> position_deltas;
+    std::string_view strings0;         // Method 0 substrings
+    std::string_view strings1;         // Method 1 lines, each followed by '\n'
+    std::vector<uint8_t> text;         // Decompressed string section, if it was compressed
+};
+
 // Forward declarations
-void printRecord(const Record& record, int idx);
-std::vector<Record> byteArrayDecoding(BitInBuffer& stream);
-double main_decoding_decompress(const std::string& input_path, const std::string& output_path);
+// Decode one block laid out as format_flags describe, returns false at the
+// end marker (an empty block). parallel_columns decodes its columns on
+// separate threads. dictionary is the archive's zstd dictionary, if any.
+bool byteArrayDecoding(BitInBuffer& stream, DecodedColumns& columns, uint8_t format_flags = 0,
+                       bool parallel_columns = false, const ZstdDictionary* dictionary = nullptr);
+double main_decoding_decompress(const std::string& input_path, const std::string& output_path, int threads = 1);
 
 // Struct definitions for internal use
 struct Method0Fields {
@@ -1,136 +1,129 @@
 #include "rle.hpp"
-#include "utils.hpp"
 #include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cassert>
+#include <cstdint>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-// Calculate the number of bits in binary representation
-// Return at least 2 for numbers less than 2
-int getBinaryLength(int num) {
-    int len = 0;
-    while (num > 0) {
-        len++;
-        num /= 2;
+std::vector<uint64_t> findRuns(const std::vector<int>& arr) {
+    std::vector<uint64_t> runs;
+    const int* data = arr.data();
+    const size_t n = arr.size();
+    size_t start = 0;  // First element of the current run
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Compare eight elements with their successors at a time and walk the
+    // set bits of the mismatch mask
+    for (; i + 8 < n; i += 8) {
+        const __m128i* p = reinterpret_cast<const __m128i*>(data + i);
+        const __m128i* q = reinterpret_cast<const __m128i*>(data + i + 1);
+        unsigned equal =
+            static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(p), _mm_loadu_si128(q))))) |
+            static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(p + 1), _mm_loadu_si128(q + 1))))) << 4;
+        unsigned mask = ~equal & 0xFF;
+        while (mask != 0) {
+            size_t end = i + __builtin_ctz(mask) + 1;
+            runs.push_back(end - start);
+            start = end;
+            mask &= mask - 1;
+        }
     }
-    return (len < 2) ? 2 : len;
-}
-
-// Encode a single number into binary string
-std::string encodeNumber(int num) {
-    int n = getBinaryLength(num);
-    std::string result;
-    
-    // Add (n-2) '1's
-    result.append(n-2, '1');
-    result += '0';
-    
-    // Convert num to binary
-    std::string binary;
-    if (num == 1) {
-        binary = "01";
-    } else {
-        while (num > 0) {
-            binary = (char)('0' + (num % 2)) + binary;
-            num /= 2;
+#endif
+    for (; i + 1 < n; i++) {
+        if (data[i] != data[i + 1]) {
+            runs.push_back(i + 1 - start);
+            start = i + 1;
         }
     }
-    
-    result += binary;
-    return result;
+    runs.push_back(n - start);
+    return runs;
 }
 
-// Decode a single number from binary string
-int decodeNumber(const std::string& binary, size_t& pos) {
-    int countOnes = 0;
-    
-    // Count leading ones
-    while (pos < binary.length() && binary[pos] == '1') {
-        countOnes++;
-        pos++;
+void encodeRun(uint64_t run, BitOutBuffer& stream) {
+    int bits = std::max(2, 64 - __builtin_clzll(run));
+    int ones = bits - 2;
+    for (; ones >= 32; ones -= 32) {
+        stream.encode_32(0xFFFFFFFFu);
     }
-    
-    // Skip the '0'
-    if (pos >= binary.length()) {
-        throw std::runtime_error("Invalid binary string format: missing '0' after ones");
-    }
-    pos++;
-    
-    // Read the binary number
-    int value = 0;
-    int bitsToRead = countOnes + 2;
-    if (pos + bitsToRead > binary.length()) {
-        throw std::runtime_error("Invalid binary string format: not enough bits for number");
-    }
-    
-    for (int i = 0; i < bitsToRead; i++) {
-        value = (value << 1) | (binary[pos + i] - '0');
+    stream.encode(((1u << ones) - 1) << 1, ones + 1);
+    if (bits > 32) {
+        stream.encode(static_cast<uint32_t>(run >> 32), bits - 32);
+        stream.encode_32(static_cast<uint32_t>(run));
+    } else {
+        stream.encode(static_cast<uint32_t>(run), bits);
     }
-    pos += bitsToRead;
-    
-    return value;
 }
 
-RLEEncoded rleEncode(const std::vector<int>& arr) {
-    if (arr.empty()) return {{}, 0};
-    
-    std::string result;
-    result += ('0' + arr[0]);  // Store initial value
-    
-    // Calculate intervals between switches
-    std::vector<int> intervals;
-    int count = 1;
-    
-    for (size_t i = 1; i < arr.size(); i++) {
-        if (arr[i] != arr[i-1]) {
-            intervals.push_back(count);
-            count = 1;
-        } else {
-            count++;
+uint64_t decodeRun(BitInBuffer& stream) {
+    // Count the leading '1's a buffered word at a time, then skip the '0'
+    int ones = 0;
+    while (true) {
+        uint8_t available = stream.buffered();
+        if (available == 0) {
+            throw std::runtime_error("Invalid RLE stream: missing '0' after ones");
+        }
+        uint64_t window = stream.peek(available) << (64 - available);
+        int count = __builtin_clzll(~window);
+        if (count < available) {
+            stream.consume(count + 1);
+            ones += count;
+            break;
         }
+        stream.consume(available);
+        ones += available;
     }
-    intervals.push_back(count);
-    
-    // Encode each interval
-    for (int interval : intervals) {
-        result += encodeNumber(interval);
+    if (ones > 62) {
+        throw std::runtime_error("Invalid RLE stream: run length wider than 64 bits");
     }
-    
-    // Pad the result to ensure it's a multiple of 8 bits
-    while (result.length() % 8 != 0) {
-        result += '0';
+    return stream.decode_64(ones + 2);
+}
+
+size_t rleEncode(const std::vector<int>& arr, BitOutBuffer& stream) {
+    if (arr.empty()) return 0;
+
+    std::vector<uint64_t> runs = findRuns(arr);
+    stream.encode(arr[0], 1);  // Store initial value
+    for (uint64_t run : runs) {
+        encodeRun(run, stream);
     }
-    
-    // Convert the binary string to bytes using the existing function
-    return {stringToBytes(result), intervals.size()};
+    stream.pack();
+    return runs.size();
 }
 
-std::vector<int> rleDecode(const std::vector<unsigned char>& encoded, size_t interval_count) {
-    // Convert bytes back to binary string using the existing function
-    std::string binaryString = bytesToString(encoded);
-    if (binaryString.empty() || interval_count == 0) return {};
-    
-    int currentValue = binaryString[0] - '0';
-    size_t pos = 1;
+std::vector<int> rleDecode(BitInBuffer& stream, size_t interval_count) {
     std::vector<int> result;
-    size_t decoded_intervals = 0;
-    try {
-        while (pos < binaryString.length() && decoded_intervals < interval_count) {
-        int interval = decodeNumber(binaryString, pos);
-            if (interval <= 0) {
-                throw std::runtime_error("Invalid interval value: " + std::to_string(interval));
-            }
+    if (interval_count == 0) return result;
+
+    int currentValue = stream.decode(1);
+    for (size_t i = 0; i < interval_count; i++) {
+        uint64_t interval = decodeRun(stream);
+        if (interval == 0) {
+            throw std::runtime_error("Invalid interval value: 0");
+        }
         result.insert(result.end(), interval, currentValue);
         currentValue = 1 - currentValue;  // Toggle between 0 and 1
-            decoded_intervals++;
-        }
-    } catch (const std::exception& e) {
-        std::cerr << "Error during RLE decoding: " << e.what() << std::endl;
-        throw;
     }
+    stream.align();
     return result;
 }
 
+RLEEncoded rleEncode(const std::vector<int>& arr) {
+    BitOutBuffer stream;
+    size_t interval_count = rleEncode(arr, stream);
+    return {stream.take_bytes(), interval_count};
+}
+
+std::vector<int> rleDecode(const std::vector<unsigned char>& encoded, size_t interval_count) {
+    if (encoded.empty()) return {};
+    BitInBuffer stream;
+    stream.attach(encoded.data(), encoded.size());
+    return rleDecode(stream, interval_count);
+}
+
 // Test cases for RLE encoding and decoding
 void testRLE() {
     std::cout << "\n=== RLE Test Cases ===" << std::endl;
@@ -3,12 +3,30 @@
 
 #include <vector>
 #include <string>
+#include <cstdint>
+#include "bit_buffer.hpp"
 
 struct RLEEncoded {
     std::vector<unsigned char> bytes;
     size_t interval_count;
 };
 
+// Lengths of the runs of equal values in arr
+std::vector<uint64_t> findRuns(const std::vector<int>& arr);
+
+// Write a run length as (n-2) '1's, a '0' and the n-bit binary number,
+// where n is the bit length of the run with a minimum of 2
+void encodeRun(uint64_t run, BitOutBuffer& stream);
+// Read a run length written by encodeRun
+uint64_t decodeRun(BitInBuffer& stream);
+
+// Write an array of 0s and 1s to stream as its first value and the
+// gamma-coded lengths of its runs, padded to a byte. Returns the number of runs.
+size_t rleEncode(const std::vector<int>& arr, BitOutBuffer& stream);
+
+// Read interval_count runs written by rleEncode back into an array of 0s and 1s
+std::vector<int> rleDecode(BitInBuffer& stream, size_t interval_count);
+
 // Convert array of 0s and 1s to byte stream
 RLEEncoded rleEncode(const std::vector<int>& arr);
 
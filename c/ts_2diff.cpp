@@ -1,5 +1,6 @@
 #include "bit_buffer.hpp"
 #include "ts_2diff.hpp"
+#include "bit_unpack.hpp"
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -13,111 +14,272 @@
 #include <sys/stat.h>
 #include <bitset>
 
-constexpr int block_size = 64;
+// Values are stored as deltas from the previous value (the first from 0),
+// or as themselves or their second differences (see pfor_encode), in blocks
+// of up to MAX_BLOCK_SIZE deltas. Each block is patched
+// frame-of-reference (PFOR): every delta is stored as delta - min in
+// base_width bits, and the few that need more bits are listed as exceptions
+// holding their position and remaining high bits, so one outlier does not
+// widen the whole block.
+//
+// Stream: value count (32), blocks, padding to a byte
+// Block:  size - 1 (12)
+//         min width (6), zigzag(min) (min width)
+//         base width (6)
+//         exception count (bit length of size)
+//         if exceptions: high width (6), positions (bit length of size - 1
+//         each), high bits (high width each)
+//         low bits of each delta - min (base width each)
+constexpr size_t MAX_BLOCK_SIZE = 4096;  // Limit of the 12-bit size field
+constexpr unsigned WIDTH_BITS = 6;       // Bits of a width field, 0 to 32
+
+// Block sizes tried at each position, the one with the fewest bits per
+// value is used
+static const size_t BLOCK_SIZES[] = {32, 64, 128, 256, 512, 1024};
+
+static inline unsigned bit_length(uint64_t value) {
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+static inline uint32_t zigzag(int32_t value) {
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
 
-// Encode a single block of integers into the bit stream
-size_t encode_block(BitOutBuffer& stream, const std::vector<int>& data) {
-    if (data.empty()) return 0;
+static inline int32_t unzigzag(uint32_t value) {
+    return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1)));
+}
 
-    if (data.size() == 1) {
-        stream.encode(data[0], 32);
-        stream.encode(0, 32);
-        stream.encode(0, 12);
-        return (32 + 32 + 12 + 7) / 8;  // 转换为字节数
+// Widths chosen for one block and its encoded size
+struct BlockPlan {
+    size_t size = 0;
+    int32_t min_delta = 0;
+    unsigned base_width = 0;
+    unsigned high_width = 0;
+    size_t exceptions = 0;
+    uint64_t bits = 0;
+};
+
+// Pick the base width that minimizes the encoded size of a block whose
+// deltas are stored relative to min_delta
+static BlockPlan plan_block(const uint32_t* deltas, size_t size, int32_t min_delta) {
+    BlockPlan plan;
+    plan.size = size;
+    plan.min_delta = min_delta;
+    size_t histogram[33] = {0};
+    for (size_t i = 0; i < size; i++) {
+        histogram[bit_length(deltas[i] - static_cast<uint32_t>(min_delta))]++;
+    }
+    unsigned max_width = 32;
+    while (max_width > 0 && histogram[max_width] == 0) max_width--;
+
+    uint64_t header = 12 + WIDTH_BITS + bit_length(zigzag(min_delta)) + WIDTH_BITS + bit_length(size);
+    unsigned position_width = bit_length(size - 1);
+    uint64_t best = UINT64_MAX;
+    size_t exceptions = 0;
+    for (int width = max_width; width >= 0; width--) {
+        uint64_t bits = static_cast<uint64_t>(size) * width;
+        if (exceptions > 0) {
+            bits += WIDTH_BITS + exceptions * (position_width + max_width - width);
+        }
+        if (bits < best) {
+            best = bits;
+            plan.base_width = width;
+            plan.high_width = max_width - width;
+            plan.exceptions = exceptions;
+        }
+        exceptions += histogram[width];
     }
+    plan.bits = header + best;
+    return plan;
+}
 
-    std::vector<int> delta(data.size() - 1);
-    for (size_t i = 1; i < data.size(); ++i) {
-        delta[i - 1] = data[i] - data[i - 1];
+// Plan a block relative to its smallest delta, or to a slightly larger one
+// so that a few large negative deltas become exceptions (they wrap around
+// to large values) instead of widening the rest of the block
+static BlockPlan plan_block(const uint32_t* deltas, size_t size) {
+    std::vector<int32_t> sorted(deltas, deltas + size);
+    size_t outliers = size / 16;
+    std::nth_element(sorted.begin(), sorted.begin() + outliers, sorted.end());
+    BlockPlan plan = plan_block(deltas, size, *std::min_element(sorted.begin(), sorted.begin() + outliers + 1));
+    if (outliers > 0) {
+        BlockPlan trimmed = plan_block(deltas, size, sorted[outliers]);
+        if (trimmed.bits < plan.bits) {
+            plan = trimmed;
+        }
     }
-    int min_delta = *std::min_element(delta.begin(), delta.end());
-    int max_delta = *std::max_element(delta.begin(), delta.end());
-    int bit_len = std::max(max_delta - min_delta, 1);
-    int bit_width = 0;
-    while ((1 << bit_width) <= bit_len && bit_width < 32) ++bit_width;
-    if (bit_width == 0) bit_width = 1;  // 确保至少使用1位
-
-    // std::cout << "[ENCODE BLOCK] first_value=" << data[0]
-    //           << ", min_delta=" << min_delta
-    //           << ", delta_length=" << delta.size()
-    //           << ", bit_width=" << bit_width << std::endl;
-
-    stream.encode(data[0], 32);
-    stream.encode(min_delta, 32);
-    stream.encode((int)delta.size(), 12);
-    stream.encode(bit_width, 8);
-    for (size_t i = 0; i < delta.size(); ++i) {
-        int enc = delta[i] - min_delta;
-        stream.encode(enc, bit_width);
+    return plan;
+}
+
+static void encode_block(BitOutBuffer& stream, const uint32_t* deltas, const BlockPlan& plan) {
+    stream.encode_fixed<12>(plan.size - 1);
+    uint32_t min_code = zigzag(plan.min_delta);
+    stream.encode_fixed<WIDTH_BITS>(bit_length(min_code));
+    if (min_code != 0) {
+        stream.encode(min_code, bit_length(min_code));
+    }
+    stream.encode_fixed<WIDTH_BITS>(plan.base_width);
+    stream.encode(plan.exceptions, bit_length(plan.size));
+
+    const uint32_t base = static_cast<uint32_t>(plan.min_delta);
+    const unsigned width = plan.base_width;
+    if (plan.exceptions > 0) {
+        unsigned position_width = bit_length(plan.size - 1);
+        stream.encode_fixed<WIDTH_BITS>(plan.high_width);
+        for (size_t i = 0; i < plan.size; i++) {
+            if (bit_length(deltas[i] - base) > width) {
+                stream.encode(i, position_width);
+            }
+        }
+        for (size_t i = 0; i < plan.size; i++) {
+            uint32_t value = deltas[i] - base;
+            if (bit_length(value) > width) {
+                stream.encode(static_cast<uint32_t>(static_cast<uint64_t>(value) >> width), plan.high_width);
+            }
+        }
+    }
+    if (width > 0) {
+        for (size_t i = 0; i < plan.size; i++) {
+            stream.encode(deltas[i] - base, width);
+        }
     }
-    stream.pack();  // 确保所有位都被写入
-    return (32 + 32 + 12 + 8 + bit_width * delta.size() + 7) / 8;  // 转换为字节数
 }
 
-// Encode a full integer vector to file using ts2diff algorithm
-size_t ts2diff_encode(const std::vector<int>& data, BitOutBuffer& stream) {
-    size_t bcnt = data.size() / block_size;
-    size_t realBcnt = (data.size() + block_size - 1) / block_size;
-    stream.encode((int)realBcnt, 32);
-    size_t total_bytes = 4;  // 初始32位转换为字节
-    for (size_t i = 0; i < bcnt; ++i) {
-        total_bytes += encode_block(stream, std::vector<int>(data.begin() + i * block_size, data.begin() + (i + 1) * block_size));
+size_t pfor_encode(const std::vector<int>& data, BitOutBuffer& stream, unsigned delta_order) {
+    if (delta_order > 2) {
+        throw std::invalid_argument("Invalid delta order: " + std::to_string(delta_order));
+    }
+    uint64_t total_bits = 0;
+
+    // Deltas in unsigned arithmetic, which wraps instead of overflowing
+    std::vector<uint32_t> deltas(data.begin(), data.end());
+    for (unsigned order = 0; order < delta_order; order++) {
+        uint32_t previous = 0;
+        for (uint32_t& value : deltas) {
+            uint32_t current = value;
+            value = current - previous;
+            previous = current;
+        }
     }
-    if (bcnt * block_size < data.size()) {
-        total_bytes += encode_block(stream, std::vector<int>(data.begin() + bcnt * block_size, data.end()));
+
+    size_t position = 0;
+    while (position < deltas.size()) {
+        size_t remaining = deltas.size() - position;
+        BlockPlan best;
+        for (size_t block_size : BLOCK_SIZES) {
+            BlockPlan plan = plan_block(deltas.data() + position, std::min(block_size, remaining));
+            if (best.size == 0 || plan.bits * best.size < best.bits * plan.size) {
+                best = plan;
+            }
+            if (block_size >= remaining) break;
+        }
+        encode_block(stream, deltas.data() + position, best);
+        position += best.size;
+        total_bits += best.bits;
     }
-    return total_bytes;
+    stream.pack();
+    return (total_bits + 7) / 8;
 }
 
-// Decode a single block of integers from the bit stream - optimized
-std::vector<int> decode_block(BitInBuffer& stream) {
-    stream.align();  // 使用公开方法确保位对齐
-    int first_value = stream.decode(32);
-    int min_delta = stream.decode(32);
-    int delta_length = stream.decode(12);
-    
-    if (delta_length == 0) {
-        return {first_value};  // Return single element vector
+// Encode a full integer vector to file using ts2diff algorithm
+size_t ts2diff_encode(const std::vector<int>& data, BitOutBuffer& stream) {
+    stream.encode_32(data.size());
+    return 4 + pfor_encode(data, stream, 1);
+}
+
+// Decode a block and append its values to result. With prefix_sum the block
+// holds deltas: previous is the value before the block and becomes its last
+// value. Otherwise it holds the values themselves.
+static void decode_block(BitInBuffer& stream, std::vector<int>& result, bool prefix_sum, uint32_t& previous) {
+    size_t size = stream.decode(12) + 1;
+    unsigned min_width = stream.decode(WIDTH_BITS);
+    if (min_width > 32) {
+        throw std::runtime_error("Invalid bit width: " + std::to_string(min_width));
     }
-    
-    int bit_width = stream.decode(8);
-    if (bit_width < 1 || bit_width > 32) {
-        throw std::runtime_error("Invalid bit width: " + std::to_string(bit_width));
+    int32_t min_delta = min_width > 0 ? unzigzag(stream.decode(min_width)) : 0;
+    unsigned width = stream.decode(WIDTH_BITS);
+    if (width > 32) {
+        throw std::runtime_error("Invalid bit width: " + std::to_string(width));
+    }
+    size_t exceptions = stream.decode(bit_length(size));
+    if (exceptions > size) {
+        throw std::runtime_error("Invalid exception count: " + std::to_string(exceptions));
     }
 
-    // Pre-allocate result vector
-    std::vector<int> result;
-    result.reserve(delta_length + 1);
-    result.push_back(first_value);
-    
-    // Decode deltas and accumulate directly
-    int acc = first_value;
-    for (int i = 0; i < delta_length; ++i) {
-        int d = stream.decode(bit_width) + min_delta;
-        acc += d;
-        result.push_back(acc);
+    // Exceptions are rare, read them before the low bits they patch
+    std::vector<uint16_t> positions;
+    std::vector<uint32_t> highs;
+    if (exceptions > 0) {
+        unsigned high_width = stream.decode(WIDTH_BITS);
+        if (high_width == 0 || width + high_width > 32) {
+            throw std::runtime_error("Invalid bit width: " + std::to_string(high_width));
+        }
+        unsigned position_width = bit_length(size - 1);
+        positions.resize(exceptions);
+        highs.resize(exceptions);
+        for (size_t e = 0; e < exceptions; e++) {
+            positions[e] = position_width > 0 ? stream.decode(position_width) : 0;
+            if (positions[e] >= size) {
+                throw std::runtime_error("Invalid exception position: " + std::to_string(positions[e]));
+            }
+        }
+        for (size_t e = 0; e < exceptions; e++) {
+            highs[e] = stream.decode(high_width);
+        }
     }
 
-    return result;
+    // Unpack the low bits straight from the buffer, patch in the exceptions
+    // and turn the deltas into values with a prefix sum
+    uint64_t bit = stream.bit_offset();
+    size_t start = bit / 8;
+    unsigned first_bit = bit % 8;
+    size_t packed_bytes = bit_unpack_bytes(first_bit, width, size);
+    if (packed_bytes > stream.size() - start) {
+        throw std::runtime_error("Attempting to read past end of buffer");
+    }
+    size_t old_size = result.size();
+    result.resize(old_size + size);
+    uint32_t* values = reinterpret_cast<uint32_t*>(result.data() + old_size);
+    bit_unpack(stream.data() + start, packed_bytes, first_bit, width, size, values);
+    stream.seek_bits(bit + static_cast<uint64_t>(width) * size);
+    for (size_t e = 0; e < exceptions; e++) {
+        values[positions[e]] |= highs[e] << width;
+    }
+    if (prefix_sum) {
+        delta_decode(values, size, static_cast<int32_t>(previous), min_delta);
+        previous = values[size - 1];
+    } else {
+        for (size_t i = 0; i < size; i++) {
+            values[i] += static_cast<uint32_t>(min_delta);
+        }
+    }
 }
 
-// Decode a file using ts2diff algorithm into a vector of integers - optimized
-std::vector<int> ts2diff_decode(BitInBuffer& stream) {
-    int realBcnt = stream.decode(32);
-    
-    // Pre-allocate result vector with estimated size
+std::vector<int> pfor_decode(BitInBuffer& stream, size_t count, unsigned delta_order) {
+    if (delta_order > 2) {
+        throw std::invalid_argument("Invalid delta order: " + std::to_string(delta_order));
+    }
     std::vector<int> result;
-    result.reserve(realBcnt * block_size);  // Reserve space for all blocks
-    
-    for (int i = 0; i < realBcnt; ++i) {
-        std::vector<int> block = decode_block(stream);
-        // Use move semantics to avoid copying
-        result.insert(result.end(), std::make_move_iterator(block.begin()), std::make_move_iterator(block.end()));
+    result.reserve(std::min(count, MAX_BLOCK_SIZE * 256));
+    uint32_t previous = 0;
+    while (result.size() < count) {
+        decode_block(stream, result, delta_order > 0, previous);
+        if (result.size() > count) {
+            throw std::runtime_error("ts2diff block exceeds the value count " + std::to_string(count));
+        }
+    }
+    // The blocks of second differences decode to first differences
+    if (delta_order == 2) {
+        delta_decode(reinterpret_cast<uint32_t*>(result.data()), result.size(), 0, 0);
     }
     stream.align();  // 确保解码后对齐到字节边界
     return result;
 }
 
+// Decode a file using ts2diff algorithm into a vector of integers - optimized
+std::vector<int> ts2diff_decode(BitInBuffer& stream) {
+    size_t count = stream.decode_32();
+    return pfor_decode(stream, count, 1);
+}
 
 // 获取文件字节数
 size_t get_file_size(const std::string& filename) {
@@ -6,10 +6,16 @@
 #include <cstddef>
 #include "bit_buffer.hpp"
 
+// Write data as its value count (32) and PFOR blocks of its deltas, padded
+// to a byte. Returns the encoded size in bytes.
 size_t ts2diff_encode(const std::vector<int>& data, BitOutBuffer& stream);
-size_t encode_block(BitOutBuffer& stream, const std::vector<int>& data);
 std::vector<int> ts2diff_decode(BitInBuffer& stream);
-std::vector<int> decode_block(BitInBuffer& stream);
+
+// The PFOR blocks of ts2diff without the value count. delta_order 0 stores
+// the values themselves, 1 their deltas (ts2diff) and 2 the deltas of the
+// deltas, which suits steadily growing values.
+size_t pfor_encode(const std::vector<int>& data, BitOutBuffer& stream, unsigned delta_order);
+std::vector<int> pfor_decode(BitInBuffer& stream, size_t count, unsigned delta_order);
 std::vector<int> ts2diff_decode_from_buffer(BitInBuffer& stream);
 
 #endif // TS_2DIFF_HPP
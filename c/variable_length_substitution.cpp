@@ -10,7 +10,7 @@
 #include <iomanip>   // For std::setprecision
 #include <fstream>   // For file operations
 
-std::vector<Position> getSearchRange(int x, int y, const std::string& str1, const std::string& str2, int lmax = 3) {
+std::vector<Position> getSearchRange(int x, int y, std::string_view str1, std::string_view str2, int lmax = 3) {
     std::vector<Position> K;  // Store feasible position tuples
     
     // Check boundary conditions
@@ -52,7 +52,7 @@ std::vector<Position> getSearchRange(int x, int y, const std::string& str1, cons
 }
 
 std::pair<std::vector<OperationItem>, double> getSubstitutionOplist(
-    const std::string& str1, const std::string& str2) {
+    std::string_view str1, std::string_view str2) {
     
     std::vector<OperationItem> operationList;
     double distance = 0;
@@ -167,7 +167,7 @@ std::pair<std::vector<OperationItem>, double> getSubstitutionOplist(
         // Create substitution operation using stored previous position
         int del_len = i - prev_pos.i;
         int ins_len = j - prev_pos.j;
-        std::string new_text = str2.substr(prev_pos.j, ins_len);
+        std::string new_text(str2.substr(prev_pos.j, ins_len));
         
         temp_ops.emplace_back(prev_pos.i, del_len, ins_len, new_text);
         
@@ -206,7 +206,7 @@ std::pair<std::vector<OperationItem>, double> getSubstitutionOplist(
 
 std::string recoverSubstitutionString(
     const std::vector<OperationItem>& operationList,
-    const std::string& str1) {
+    std::string_view str1) {
     
     std::string result;
     size_t oldPos = 0;
@@ -230,7 +230,7 @@ std::string recoverSubstitutionString(
 
 // 辅助函数：打印 DP 表格为 CSV 格式并保存到文件
 void printDPTableCSV(const std::vector<std::vector<double>>& dp, 
-                     const std::string& str1, const std::string& str2) {
+                     std::string_view str1, std::string_view str2) {
     std::cout << "\n=== DP 表格 (CSV 格式) ===\n";
     
     // 创建 CSV 文件
@@ -2,6 +2,7 @@
 #define VARIABLE_LENGTH_SUBSTITUTION_HPP
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <tuple>
 #include "qgram_match.hpp"
@@ -24,14 +25,14 @@ std::vector<Position> getSearchRange(int i, int j);
 
 // Get substitution operations and distance for variable length strings
 std::pair<std::vector<OperationItem>, double> getSubstitutionOplist(
-    const std::string& str1,
-    const std::string& str2
+    std::string_view str1,
+    std::string_view str2
 );
 
 // Recover string using substitution operation list
 std::string recoverSubstitutionString(
     const std::vector<OperationItem>& operationList,
-    const std::string& str1
+    std::string_view str1
 );
 
 #endif // VARIABLE_LENGTH_SUBSTITUTION_HPP 
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include "varint.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VARINT_X86 1
+#endif
+
+static inline unsigned byte_count(uint32_t value) {
+    return value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+}
+
+void varint_encode(const std::vector<int>& values, BitOutBuffer& stream) {
+    size_t count = values.size();
+    size_t control_size = (count + 3) / 4;
+    std::vector<uint8_t> bytes(control_size + count * 4, 0);
+    uint8_t* control = bytes.data();
+    uint8_t* out = control + control_size;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = static_cast<uint32_t>(values[i]);
+        unsigned length = byte_count(value);
+        control[i / 4] |= (length - 1) << (2 * (i % 4));
+        for (unsigned b = 0; b < length; b++) {
+            *out++ = static_cast<uint8_t>(value >> (8 * b));
+        }
+    }
+    stream.pack();
+    stream.append_bytes(bytes.data(), out - bytes.data());
+}
+
+#ifdef VARINT_X86
+// Byte shuffle that spreads the value bytes of a control byte into four
+// 32-bit lanes, and the number of value bytes it covers
+struct ShuffleTable {
+    uint8_t masks[256][16];
+    uint8_t lengths[256];
+
+    ShuffleTable() {
+        for (unsigned control = 0; control < 256; control++) {
+            unsigned offset = 0;
+            for (unsigned k = 0; k < 4; k++) {
+                unsigned length = ((control >> (2 * k)) & 3) + 1;
+                for (unsigned b = 0; b < 4; b++) {
+                    masks[control][k * 4 + b] = b < length ? static_cast<uint8_t>(offset + b) : 0x80;
+                }
+                offset += length;
+            }
+            lengths[control] = static_cast<uint8_t>(offset);
+        }
+    }
+};
+
+// Decode whole groups of four values while 16 bytes can be loaded before
+// end, returns the number of groups decoded
+__attribute__((target("ssse3")))
+static size_t decode_groups_ssse3(const uint8_t* control, size_t groups,
+                                  const uint8_t*& data, const uint8_t* end, uint32_t* out) {
+    static const ShuffleTable table;
+    size_t g = 0;
+    for (; g < groups && end - data >= 16; g++) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table.masks[control[g]]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + g * 4), _mm_shuffle_epi8(bytes, mask));
+        data += table.lengths[control[g]];
+    }
+    return g;
+}
+#endif
+
+std::vector<int> varint_decode(BitInBuffer& stream, size_t count) {
+    stream.align();
+    size_t start = stream.byte_offset();
+    size_t control_size = (count + 3) / 4;
+    if (control_size > stream.size() - start) {
+        throw std::runtime_error("Varint data is shorter than " + std::to_string(count) + " values");
+    }
+    const uint8_t* control = stream.data() + start;
+    const uint8_t* data = control + control_size;
+    const uint8_t* end = stream.data() + stream.size();
+
+    std::vector<int> result(count);
+    uint32_t* out = reinterpret_cast<uint32_t*>(result.data());
+    size_t i = 0;
+#ifdef VARINT_X86
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+    if (has_ssse3) {
+        i = decode_groups_ssse3(control, count / 4, data, end, out) * 4;
+    }
+#endif
+    for (; i < count; i++) {
+        unsigned length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        if (static_cast<size_t>(end - data) < length) {
+            throw std::runtime_error("Varint data is shorter than " + std::to_string(count) + " values");
+        }
+        uint32_t value = 0;
+        for (unsigned b = 0; b < length; b++) {
+            value |= static_cast<uint32_t>(data[b]) << (8 * b);
+        }
+        out[i] = value;
+        data += length;
+    }
+    stream.seek(data - stream.data());
+    return result;
+}
@@ -0,0 +1,16 @@
+#ifndef VARINT_HPP
+#define VARINT_HPP
+
+#include <vector>
+#include <cstddef>
+#include "bit_buffer.hpp"
+
+// Stream VByte: each value takes 1 to 4 little-endian bytes, and its byte
+// count - 1 is kept apart in 2-bit fields, four to a control byte. The
+// stream is padded to a byte, then holds the control bytes followed by the
+// value bytes. Negative values take 4 bytes.
+void varint_encode(const std::vector<int>& values, BitOutBuffer& stream);
+// Read count values written by varint_encode
+std::vector<int> varint_decode(BitInBuffer& stream, size_t count);
+
+#endif // VARINT_HPP